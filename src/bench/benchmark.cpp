@@ -0,0 +1,80 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <numeric>
+
+#include "bench/benchmark.hpp"
+#include "utility/utility.hpp"
+
+
+bench::harness::harness (const boost::program_options::variables_map& options)
+: harness (options["bench-warmup"].as<std::size_t>(), options["bench-samples"].as<std::size_t>(),
+           options["bench-filter"].as<std::string>())
+{
+    if (samples < 1) {
+        std::cerr << "bench-samples must be at least 1\n";
+        std::exit (EXIT_FAILURE);
+    }
+}
+
+
+auto bench::harness::program_options () -> boost::program_options::options_description {
+    namespace po = boost::program_options;
+    po::options_description options ("Benchmark Options");
+    options.add_options()
+    ("bench-warmup", po::value<std::size_t>()->default_value(5), "untimed samples before timing each benchmark")
+    ("bench-samples", po::value<std::size_t>()->default_value(50), "timed samples for each benchmark")
+    ("bench-filter", po::value<std::string>()->default_value(""), "only run benchmarks whose names contain this")
+    ("bench-output", po::value<std::string>(), "file for JSON results (standard output if unset)")
+    ("bench-label", po::value<std::string>()->default_value(""), "label recorded with the results, e.g. a commit id");
+    return options;
+}
+
+
+void bench::harness::record (const std::string& name, std::size_t operations, std::vector<double>& times) {
+
+    assert (!times.empty() && operations > 0);
+
+    for (auto& time : times) time /= operations;
+    std::sort (times.begin(), times.end());
+
+    // Nearest-rank percentile of the sorted times
+    const auto percentile = [&](double p) {
+        const std::size_t rank = std::size_t (std::ceil (p * times.size()));
+        return times[std::min (std::max<std::size_t> (rank, 1), times.size()) - 1];
+    };
+
+    timing result;
+    result.name = name;
+    result.samples = times.size();
+    result.operations = operations;
+    result.min = times.front();
+    result.median = percentile (0.5);
+    result.p90 = percentile (0.9);
+    result.p99 = percentile (0.99);
+    result.max = times.back();
+    result.mean = std::accumulate (times.begin(), times.end(), 0.0) / times.size();
+    results.push_back (result);
+
+    std::cerr << name << ": median " << result.median << " ns/op, p90 " << result.p90 << " ns/op\n";
+}
+
+
+void bench::harness::write_json (std::ostream& out, const std::string& label) const {
+
+    out << "{\n  \"label\": " << utility::quoted (label) << ",\n  \"warmup\": " << warmup
+    << ",\n  \"samples\": " << samples << ",\n  \"unit\": \"ns/op\",\n  \"benchmarks\": [";
+
+    for (std::size_t i = 0; i < results.size(); ++i) {
+        const timing& r = results[i];
+        out << (i == 0 ? "\n" : ",\n")
+        << "    { \"name\": " << utility::quoted (r.name) << ", \"samples\": " << r.samples
+        << ", \"operations\": " << r.operations << ", \"min\": " << r.min << ", \"median\": " << r.median
+        << ", \"p90\": " << r.p90 << ", \"p99\": " << r.p99 << ", \"max\": " << r.max
+        << ", \"mean\": " << r.mean << " }";
+    }
+
+    out << "\n  ]\n}\n";
+}
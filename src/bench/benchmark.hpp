@@ -0,0 +1,101 @@
+#ifndef slam_bench_benchmark_hpp
+#define slam_bench_benchmark_hpp
+
+#include <chrono>
+#include <cstddef>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+#include <boost/program_options.hpp>
+
+
+namespace bench {
+
+
+    /** Prevents the compiler from discarding a value whose computation is being timed. */
+    template <class T>
+    inline void do_not_optimise (const T& value) {
+#if defined(__GNUC__) || defined(__clang__)
+        asm volatile ("" : : "g"(&value) : "memory");
+#else
+        static volatile const void* sink;
+        sink = &value;
+#endif
+    }
+
+
+    /** Time per operation in nanoseconds, summarised over the timed samples of one benchmark. */
+    struct timing {
+        std::string name;
+        std::size_t samples;
+        std::size_t operations;
+        double min, median, p90, p99, max, mean;
+    };
+
+
+    /** Runs each benchmark for a number of untimed warm-up samples followed by timed samples, and
+     collects the distribution of the time per operation. Workloads use fixed sizes and seeds, so
+     results written by different commits can be compared directly. */
+    class harness {
+
+        std::size_t warmup, samples;
+        std::string filter;
+        std::vector<timing> results;
+
+        void record (const std::string& name, std::size_t operations, std::vector<double>& times);
+
+    public:
+
+        harness (std::size_t warmup, std::size_t samples, const std::string& filter = "")
+        : warmup(warmup), samples(samples), filter(filter) { }
+
+        explicit harness (const boost::program_options::variables_map&);
+
+        static boost::program_options::options_description program_options ();
+
+        /** Whether the named benchmark is selected, so callers can skip expensive setup. */
+        bool enabled (const std::string& name) const {
+            return filter.empty() || name.find (filter) != std::string::npos;
+        }
+
+        /** Times function, which performs the given number of operations per call. Before each
+         call, setup is run outside the timed region. */
+        template <class Setup, class Function>
+        void run (const std::string& name, std::size_t operations, Setup setup, Function function);
+
+        template <class Function>
+        void run (const std::string& name, std::size_t operations, Function function) {
+            run (name, operations, []{}, function);
+        }
+
+        auto get_results () const -> const std::vector<timing>& { return results; }
+
+        void write_json (std::ostream&, const std::string& label) const;
+    };
+
+}
+
+
+template <class Setup, class Function>
+void bench::harness::run (const std::string& name, std::size_t operations, Setup setup, Function function) {
+
+    if (!enabled (name)) return;
+
+    using clock = std::chrono::steady_clock;
+
+    std::vector<double> times;
+    times.reserve (samples);
+
+    for (std::size_t i = 0; i < warmup + samples; ++i) {
+        setup();
+        const auto start = clock::now();
+        function();
+        const auto end = clock::now();
+        if (i >= warmup) times.push_back (std::chrono::duration<double, std::nano>(end - start).count());
+    }
+
+    record (name, operations, times);
+}
+
+#endif
@@ -0,0 +1,333 @@
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/program_options.hpp>
+#include <boost/range/adaptor/map.hpp>
+
+#include <Eigen/Core>
+
+#include "bench/benchmark.hpp"
+#include "bench/time_to_accuracy.hpp"
+#include "planar_robot/pose.hpp"
+#include "planar_robot/position.hpp"
+#include "slam/slam_data.hpp"
+#include "slam/slam_initialiser.hpp"
+#include "slam/mcmc_slam.hpp"
+#include "slam/multi_mcmc.hpp"
+#include "slam/g2o_slam.hpp"
+#include "slam/particle_filter.hpp"
+#include "utility/bitree.hpp"
+#include "utility/flat_map.hpp"
+#include "utility/random.hpp"
+#include "utility/unscented.hpp"
+
+#include "main.hpp"
+#include "dataset.hpp"
+
+using planar_robot::pose;
+using planar_robot::position;
+
+using slam_data_type = slam::slam_data<control_model_type, observation_model_type>;
+using slam_dataset_type = slam::dataset<control_model_type, observation_model_type>;
+using slam_initialiser_type = slam::slam_initialiser<control_model_type, observation_model_type>;
+using mcmc_slam_type = slam::mcmc_slam<control_model_type, observation_model_type>;
+using multi_mcmc_type = slam::multi_mcmc<control_model_type, observation_model_type>;
+using g2o_slam_type = slam::g2o_slam<control_model_type, observation_model_type>;
+
+namespace {
+
+    // Every workload is generated from fixed seeds so that runs on different commits agree
+    const unsigned int bench_seed = 1;
+    const std::size_t batch = 1024;
+
+
+    auto random_pose (random_source& random) -> pose {
+        return pose::cartesian (10 * random.normal(), 10 * random.normal(), random.normal());
+    }
+
+
+    void bench_bitree (bench::harness& harness) {
+
+        const std::size_t size = 1 << 14;
+
+        random_source random (bench_seed);
+        std::vector<pose> poses;
+        std::vector<std::size_t> indices;
+        for (std::size_t i = 0; i < size; ++i) poses.push_back (random_pose (random));
+        for (std::size_t i = 0; i < batch; ++i) indices.push_back (random() % size);
+
+        utility::bitree<pose> tree;
+        utility::bitree<double> weights;
+        for (const auto& p : poses) {
+            tree.push_back (p);
+            weights.push_back (random.uniform());
+        }
+
+        utility::bitree<pose> scratch;
+        harness.run ("bitree/push_back", size, [&]{ scratch.clear(); }, [&]{
+            for (const auto& p : poses) scratch.push_back (p);
+            bench::do_not_optimise (scratch);
+        });
+
+        harness.run ("bitree/get", batch, [&]{
+            for (auto i : indices) bench::do_not_optimise (pose (tree[i]));
+        });
+
+        harness.run ("bitree/set", batch, [&]{
+            for (auto i : indices) tree[i] = poses[i];
+        });
+
+        harness.run ("bitree/accumulate", batch, [&]{
+            for (auto i : indices) bench::do_not_optimise (tree.accumulate (i));
+        });
+
+        std::vector<pose> states (size+1);
+        harness.run ("bitree/accumulate_range", size+1, [&]{
+            tree.accumulate_range (0, size+1, states.begin());
+            bench::do_not_optimise (states);
+        });
+
+        const double total = weights.accumulate();
+        std::vector<double> targets;
+        for (std::size_t i = 0; i < batch; ++i) targets.push_back (total * random.uniform());
+        harness.run ("bitree/binary_search", batch, [&]{
+            for (auto target : targets) bench::do_not_optimise (weights.binary_search (target));
+        });
+    }
+
+
+    void bench_pose (bench::harness& harness) {
+
+        random_source random (bench_seed);
+        std::vector<pose> a, b;
+        std::vector<position> positions;
+        for (std::size_t i = 0; i < batch; ++i) {
+            a.push_back (random_pose (random));
+            b.push_back (random_pose (random));
+            positions.push_back (position::cartesian (10 * random.normal(), 10 * random.normal()));
+        }
+
+        harness.run ("pose/compose", batch, [&]{
+            for (std::size_t i = 0; i < batch; ++i) bench::do_not_optimise (a[i] + b[i]);
+        });
+
+        harness.run ("pose/inverse_compose", batch, [&]{
+            for (std::size_t i = 0; i < batch; ++i) bench::do_not_optimise (-a[i] + b[i]);
+        });
+
+        harness.run ("pose/transform_position", batch, [&]{
+            for (std::size_t i = 0; i < batch; ++i) bench::do_not_optimise (a[i] + positions[i]);
+        });
+    }
+
+
+    void bench_models (bench::harness& harness,
+                       const control_model_type::builder& control_builder,
+                       const observation_model_type::builder& observation_builder) {
+
+        random_source random (bench_seed);
+        std::vector<pose> poses;
+        std::vector<position> positions;
+        for (std::size_t i = 0; i < batch; ++i) {
+            poses.push_back (pose::cartesian (random.normal(), 0.1 * random.normal(), 0.1 * random.normal()));
+            positions.push_back (position::cartesian (10 * random.normal(), 10 * random.normal()));
+        }
+
+        const control_model_type control = control_builder (control_model_type::vector_type (1.0, 0.1), 1.0);
+        const observation_model_type observation = observation_builder (observation_model_type::vector_type::Constant (10.0));
+
+        harness.run ("velocity_model/observe", batch, [&]{
+            for (const auto& p : poses) bench::do_not_optimise (control_model_type::observe (p));
+        });
+
+        harness.run ("velocity_model/log_likelihood", batch, [&]{
+            for (const auto& p : poses) bench::do_not_optimise (control.log_likelihood (control_model_type::observe (p)));
+        });
+
+        harness.run ("range_only_model/observe", batch, [&]{
+            for (const auto& p : positions) bench::do_not_optimise (observation_model_type::observe (p));
+        });
+
+        harness.run ("range_only_model/log_likelihood", batch, [&]{
+            for (const auto& p : positions) {
+                bench::do_not_optimise (observation.log_likelihood (observation_model_type::observe (p)));
+            }
+        });
+    }
+
+
+    void bench_unscented (bench::harness& harness) {
+
+        const unscented_params<3> params (0.002, 2, 0);
+
+        multivariate_normal_dist<3> state;
+        state.mean() << 1.0, 2.0, 0.5;
+        state.chol_cov() = 0.1 * Eigen::Matrix3d::Identity();
+
+        const Eigen::Matrix2d noise = 0.05 * Eigen::Matrix2d::Identity();
+        const Eigen::Vector2d landmark (5.0, -3.0);
+
+        // Range and bearing to a fixed landmark from the given pose
+        const auto observe = [&](const Eigen::Vector3d& s) -> Eigen::Vector2d {
+            const Eigen::Vector2d delta = landmark - s.head<2>();
+            return Eigen::Vector2d (delta.norm(), std::atan2 (delta.y(), delta.x()) - s(2));
+        };
+
+        multivariate_normal_dist<2> result;
+        harness.run ("unscented_transform/range_bearing", batch, [&]{
+            for (std::size_t i = 0; i < batch; ++i) {
+                unscented_transform (params, observe, state, result, noise);
+                bench::do_not_optimise (result);
+            }
+        });
+    }
+
+
+    void bench_particle_filter (bench::harness& harness) {
+
+        struct particle_type { pose state; };
+
+        const std::size_t num_particles = 1000;
+        random_source random (bench_seed);
+
+        slam::particle_filter<particle_type> particles;
+        particles.reinitialize (num_particles, [&]{ return particle_type { random_pose (random) }; });
+
+        harness.run ("particle_filter/resample", num_particles, [&]{
+            particles.update ([&](particle_type&) { return random.uniform(); });
+        }, [&]{
+            particles.resample (random);
+        });
+    }
+
+
+    /** The estimators are driven with the bundled Plaza1 dataset. */
+    void bench_estimators (bench::harness& harness,
+                           const control_model_type::builder& control_builder,
+                           const observation_model_type::builder& observation_builder,
+                           const std::string& dataset_dir) {
+
+        harness.run ("dataset/read_plaza1", 1, [&]{
+            bench::do_not_optimise (read_range_only_data (dataset_dir, "Plaza1"));
+        });
+
+        const bool run_mcmc = harness.enabled ("mcmc_slam/");
+        const bool run_g2o = harness.enabled ("g2o_slam/");
+        if (!run_mcmc && !run_g2o) return;
+
+        std::shared_ptr<slam_dataset_type> dataset;
+        std::tie (dataset, std::ignore) = read_range_only_data (dataset_dir, "Plaza1");
+
+        auto data = std::make_shared<slam_data_type>();
+        auto init = std::make_shared<slam_initialiser_type> (bench_seed);
+        data->add_listener (init);
+
+        std::shared_ptr<mcmc_slam_type> mcmc_slam;
+        if (run_mcmc) {
+            mcmc_slam = std::make_shared<mcmc_slam_type> (data, bench_seed);
+            mcmc_slam->set_initialiser (init);
+            data->add_timestep_listener (mcmc_slam);
+        }
+
+        std::shared_ptr<g2o_slam_type> g2o_slam;
+        if (run_g2o) {
+            g2o_slam = std::make_shared<g2o_slam_type> (init);
+            data->add_listener (g2o_slam);
+        }
+
+        data->add_dataset (*dataset, control_builder, observation_builder);
+
+        if (mcmc_slam) {
+
+            random_source random (bench_seed);
+            std::vector<slam::timestep_type> timesteps;
+            std::vector<slam::featureid_type> features;
+            std::vector<slam::featureid_type> feature_ids;
+            for (auto id : boost::adaptors::keys (mcmc_slam->get_feature_map())) feature_ids.push_back (id);
+            for (std::size_t i = 0; i < batch; ++i) {
+                timesteps.emplace_back (random() % mcmc_slam->current_timestep());
+                features.push_back (feature_ids[random() % feature_ids.size()]);
+            }
+
+            harness.run ("mcmc_slam/update_state", batch, [&]{
+                for (auto t : timesteps) mcmc_slam->update_state (t);
+            });
+
+            harness.run ("mcmc_slam/update_feature", batch, [&]{
+                for (auto id : features) mcmc_slam->update_feature (id);
+            });
+
+            harness.run ("mcmc_slam/update", batch, [&]{
+                for (std::size_t i = 0; i < batch; ++i) mcmc_slam->update();
+            });
+        }
+
+        if (g2o_slam) {
+            harness.run ("g2o_slam/optimise", 1, [&]{ g2o_slam->reinitialise (*init); }, [&]{
+                bench::do_not_optimise (g2o_slam->optimise (10));
+            });
+        }
+    }
+
+}
+
+
+int main (int argc, char* argv[]) {
+
+    namespace po = boost::program_options;
+
+    po::options_description options ("Command Line Options");
+    options.add_options()
+    ("help,h", "usage information")
+    ("dataset-dir", po::value<std::string>()->default_value("input"), "location of datasets");
+    options.add (bench::harness::program_options());
+    options.add (bench::time_to_accuracy_options());
+    options.add (control_model_type::builder::program_options());
+    options.add (observation_model_type::builder::program_options());
+    options.add (mcmc_slam_type::program_options());
+    options.add (multi_mcmc_type::program_options());
+    options.add (g2o_slam_type::program_options());
+
+    po::variables_map values;
+    po::store (po::parse_command_line (argc, argv, options), values);
+    po::notify (values);
+
+    if (values.count ("help")) {
+        std::cout << options << std::endl;
+        return EXIT_SUCCESS;
+    }
+
+    std::ofstream output_file;
+    if (values.count ("bench-output")) {
+        output_file.open (values["bench-output"].as<std::string>());
+        if (!output_file) {
+            std::cerr << "Could not write benchmark results: " << values["bench-output"].as<std::string>() << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    std::ostream& out = output_file.is_open() ? output_file : std::cout;
+
+    if (values.count ("time-to-accuracy")) {
+        bench::time_to_accuracy (values, out);
+        return EXIT_SUCCESS;
+    }
+
+    const control_model_type::builder control_builder (values);
+    const observation_model_type::builder observation_builder (values);
+
+    bench::harness harness (values);
+    bench_bitree (harness);
+    bench_pose (harness);
+    bench_models (harness, control_builder, observation_builder);
+    bench_unscented (harness);
+    bench_particle_filter (harness);
+    bench_estimators (harness, control_builder, observation_builder, values["dataset-dir"].as<std::string>());
+
+    harness.write_json (out, values["bench-label"].as<std::string>());
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,248 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <boost/timer/timer.hpp>
+
+#include "bench/time_to_accuracy.hpp"
+#include "planar_robot/rms_error.hpp"
+#include "slam/slam_data.hpp"
+#include "slam/slam_initialiser.hpp"
+#include "slam/slam_likelihood.hpp"
+#include "slam/mcmc_slam.hpp"
+#include "slam/multi_mcmc.hpp"
+#include "slam/g2o_slam.hpp"
+#include "utility/utility.hpp"
+
+#include "main.hpp"
+#include "dataset.hpp"
+
+using slam_result_type = slam::slam_result_of<control_model_type, observation_model_type>;
+using slam_data_type = slam::slam_data<control_model_type, observation_model_type>;
+using slam_dataset_type = slam::dataset<control_model_type, observation_model_type>;
+using slam_initialiser_type = slam::slam_initialiser<control_model_type, observation_model_type>;
+using mcmc_slam_type = slam::mcmc_slam<control_model_type, observation_model_type>;
+using multi_mcmc_type = slam::multi_mcmc<control_model_type, observation_model_type>;
+using g2o_slam_type = slam::g2o_slam<control_model_type, observation_model_type>;
+
+namespace {
+
+    struct accuracy_sample {
+        double cpu_seconds;
+        double map_rmse;
+        double trajectory_rmse;
+        double log_likelihood_ratio;
+    };
+
+
+    /** An estimator under test, and one unit of further work once the dataset has been
+     processed. The work function returns false when the estimator cannot make progress. */
+    struct estimator {
+        std::shared_ptr<slam_result_type> result;
+        std::function<bool()> work;
+    };
+
+
+    auto make_estimator (const std::string& name, boost::program_options::variables_map& options,
+                         const std::shared_ptr<slam_data_type>& data,
+                         const std::shared_ptr<slam_initialiser_type>& init) -> estimator {
+
+        const unsigned int seed = options["accuracy-seed"].as<unsigned int>();
+        const unsigned int chunk = options["accuracy-chunk"].as<unsigned int>();
+
+        if (name == "mcmc-slam") {
+            auto mcmc_slam = std::make_shared<mcmc_slam_type> (data, seed);
+            mcmc_slam->set_initialiser (init);
+            data->add_timestep_listener (mcmc_slam);
+            data->add_timestep_listener (std::make_shared<mcmc_slam_type::updater> (mcmc_slam, options));
+            return { mcmc_slam, [=]() -> bool {
+                for (unsigned int i = 0; i < chunk; ++i) mcmc_slam->update();
+                return true;
+            }};
+        }
+        else if (name == "multi-mcmc") {
+            auto multi_mcmc = std::make_shared<multi_mcmc_type> (data, options, seed);
+            data->add_timestep_listener (multi_mcmc);
+            const unsigned int steps = std::max (chunk / multi_mcmc->num_chains(), 1u);
+            return { multi_mcmc, [=]() -> bool {
+                multi_mcmc->update (steps);
+                return true;
+            }};
+        }
+        else if (name == "g2o") {
+            auto g2o_slam = std::make_shared<g2o_slam_type> (init);
+            data->add_listener (g2o_slam);
+            data->add_timestep_listener (std::make_shared<g2o_slam_type::updater> (g2o_slam, options));
+            return { g2o_slam, [=]{ return g2o_slam->optimise (1) > 0; } };
+        }
+        else {
+            std::cerr << "Unknown estimator for time-to-accuracy benchmark: " << name << std::endl;
+            std::exit (EXIT_FAILURE);
+        }
+    }
+
+
+    double cpu_seconds (const boost::timer::cpu_timer& timer) {
+        const auto elapsed = timer.elapsed();
+        return (elapsed.user + elapsed.system) * 1e-9;
+    }
+
+
+    auto run_estimator (const std::string& dataset_name, const std::string& estimator_name,
+                        boost::program_options::variables_map& options) -> std::vector<accuracy_sample> {
+
+        std::shared_ptr<slam_dataset_type> dataset;
+        std::shared_ptr<slam_result_type> ground_truth;
+        std::tie (dataset, ground_truth) = read_range_only_data (options["dataset-dir"].as<std::string>(),
+                                                                 dataset_name);
+
+        const control_model_type::builder control_builder (options);
+        const observation_model_type::builder observation_builder (options);
+
+        auto data = std::make_shared<slam_data_type>();
+        auto init = std::make_shared<slam_initialiser_type> (options["accuracy-seed"].as<unsigned int>());
+        data->add_listener (init);
+        const estimator est = make_estimator (estimator_name, options, data, init);
+
+        const double interval = options["accuracy-interval"].as<double>();
+        const double budget = options["accuracy-budget"].as<double>();
+
+        std::vector<accuracy_sample> curve;
+        double dataset_log_likelihood = 0;
+
+        // The timer is stopped while samples are evaluated
+        boost::timer::cpu_timer timer;
+
+        const auto evaluate = [&]{
+            timer.stop();
+            accuracy_sample sample;
+            sample.cpu_seconds = cpu_seconds (timer);
+            std::tie (sample.map_rmse, sample.trajectory_rmse)
+            = planar_robot::map_traj_rmse_align_best (*ground_truth, *est.result);
+            sample.log_likelihood_ratio = slam::slam_log_likelihood (*data, *est.result) - dataset_log_likelihood;
+            curve.push_back (sample);
+            timer.resume();
+        };
+
+        // Processing the dataset online is included in the CPU time of the first sample
+        data->add_dataset (*dataset, control_builder, observation_builder);
+
+        timer.stop();
+        dataset_log_likelihood = slam::slam_log_likelihood (*data, *ground_truth);
+        timer.resume();
+        evaluate();
+
+        double next_sample = interval * (std::floor (curve.back().cpu_seconds / interval) + 1);
+        bool progress = true;
+
+        while (progress && cpu_seconds (timer) < budget) {
+            progress = est.work();
+            const double now = cpu_seconds (timer);
+            if (now >= next_sample || !progress) {
+                evaluate();
+                while (next_sample <= now) next_sample += interval;
+            }
+        }
+
+        if (curve.back().cpu_seconds < cpu_seconds (timer)) evaluate();
+
+        return curve;
+    }
+
+
+    /** CPU time of the first sample whose error is at most the threshold, or null. */
+    template <class Error>
+    void write_time_to_threshold (std::ostream& out, const std::vector<accuracy_sample>& curve,
+                                  const std::vector<double>& thresholds, Error error) {
+        out << '[';
+        for (std::size_t i = 0; i < thresholds.size(); ++i) {
+            out << (i == 0 ? " " : ", ") << "{ \"threshold\": " << thresholds[i] << ", \"cpu_seconds\": ";
+            auto sample = curve.begin();
+            while (sample != curve.end() && !(error (*sample) <= thresholds[i])) ++sample;
+            if (sample != curve.end()) out << sample->cpu_seconds;
+            else out << "null";
+            out << " }";
+        }
+        out << " ]";
+    }
+
+}
+
+
+void bench::time_to_accuracy (boost::program_options::variables_map& options, std::ostream& out) {
+
+    const auto datasets = options["accuracy-datasets"].as<std::vector<std::string>>();
+    const auto estimators = options["accuracy-estimators"].as<std::vector<std::string>>();
+    const auto traj_thresholds = options["accuracy-traj-thresholds"].as<std::vector<double>>();
+    const auto map_thresholds = options["accuracy-map-thresholds"].as<std::vector<double>>();
+
+    out << "{\n  \"label\": " << utility::quoted (options["bench-label"].as<std::string>()) << ",\n"
+    << "  \"interval\": " << options["accuracy-interval"].as<double>() << ",\n"
+    << "  \"budget\": " << options["accuracy-budget"].as<double>() << ",\n"
+    << "  \"runs\": [";
+
+    bool first_run = true;
+    for (const auto& dataset : datasets) {
+        for (const auto& estimator : estimators) {
+
+            std::cerr << "Running " << estimator << " on " << dataset << std::endl;
+            const auto curve = run_estimator (dataset, estimator, options);
+
+            const auto& last = curve.back();
+            std::cerr << "  " << last.cpu_seconds << " CPU seconds: map RMSE " << last.map_rmse
+            << ", trajectory RMSE " << last.trajectory_rmse
+            << ", log likelihood ratio " << last.log_likelihood_ratio << std::endl;
+
+            out << (first_run ? "\n" : ",\n") << "    {\n"
+            << "      \"dataset\": " << utility::quoted (dataset) << ",\n"
+            << "      \"estimator\": " << utility::quoted (estimator) << ",\n"
+            << "      \"curve\": [";
+            for (std::size_t i = 0; i < curve.size(); ++i) {
+                const accuracy_sample& s = curve[i];
+                out << (i == 0 ? "\n" : ",\n")
+                << "        { \"cpu_seconds\": " << s.cpu_seconds << ", \"map_rmse\": " << s.map_rmse
+                << ", \"trajectory_rmse\": " << s.trajectory_rmse
+                << ", \"log_likelihood_ratio\": " << s.log_likelihood_ratio << " }";
+            }
+            out << "\n      ],\n      \"time_to_trajectory_rmse\": ";
+            write_time_to_threshold (out, curve, traj_thresholds,
+                                     [](const accuracy_sample& s) { return s.trajectory_rmse; });
+            out << ",\n      \"time_to_map_rmse\": ";
+            write_time_to_threshold (out, curve, map_thresholds,
+                                     [](const accuracy_sample& s) { return s.map_rmse; });
+            out << "\n    }";
+            first_run = false;
+        }
+    }
+
+    out << "\n  ]\n}\n";
+}
+
+
+auto bench::time_to_accuracy_options () -> boost::program_options::options_description {
+    namespace po = boost::program_options;
+    po::options_description options ("Time-to-Accuracy Options");
+    options.add_options()
+    ("time-to-accuracy", "record accuracy against CPU time for whole estimators, instead of the microbenchmarks")
+    ("accuracy-datasets", po::value<std::vector<std::string>>()->multitoken()
+     ->default_value(std::vector<std::string>{"Plaza1", "Plaza2"}, "Plaza1 Plaza2"), "datasets to run on")
+    ("accuracy-estimators", po::value<std::vector<std::string>>()->multitoken()
+     ->default_value(std::vector<std::string>{"mcmc-slam", "multi-mcmc", "g2o"}, "mcmc-slam multi-mcmc g2o"),
+     "estimators to run (mcmc-slam, multi-mcmc, g2o)")
+    ("accuracy-interval", po::value<double>()->default_value(1.0), "CPU seconds between accuracy samples")
+    ("accuracy-budget", po::value<double>()->default_value(60.0), "CPU seconds for each estimator and dataset")
+    ("accuracy-chunk", po::value<unsigned int>()->default_value(1000),
+     "MCMC updates between checks of the CPU time")
+    ("accuracy-seed", po::value<unsigned int>()->default_value(1), "random seed for the estimators")
+    ("accuracy-traj-thresholds", po::value<std::vector<double>>()->multitoken()
+     ->default_value(std::vector<double>{2.0, 1.0, 0.5}, "2 1 0.5"), "trajectory RMSE thresholds")
+    ("accuracy-map-thresholds", po::value<std::vector<double>>()->multitoken()
+     ->default_value(std::vector<double>{2.0, 1.0, 0.5}, "2 1 0.5"), "map RMSE thresholds");
+    return options;
+}
@@ -0,0 +1,21 @@
+#ifndef slam_bench_time_to_accuracy_hpp
+#define slam_bench_time_to_accuracy_hpp
+
+#include <iosfwd>
+
+#include <boost/program_options.hpp>
+
+
+namespace bench {
+
+    /** Runs each selected estimator on each selected dataset and samples its aligned map and
+     trajectory RMSE and log likelihood ratio against the ground truth at fixed intervals of CPU
+     time. Writes the resulting curves, and the CPU time needed to first reach each accuracy
+     threshold, as JSON. Time spent evaluating the samples is not counted. */
+    void time_to_accuracy (boost::program_options::variables_map& options, std::ostream& out);
+
+    auto time_to_accuracy_options () -> boost::program_options::options_description;
+
+}
+
+#endif
@@ -39,7 +39,7 @@ auto read_range_only_data (boost::filesystem::path dir, const std::string& name)
         
         while (input_GT >> t >> x >> y >> bearing) {
             auto state = -initial_state + planar_robot::pose::cartesian (x, y, bearing);
-            ground_truth->get_trajectory().push_back_accumulated (state);
+            ground_truth->append_accumulated_state (state);
         }
     }
 
@@ -91,9 +91,10 @@ auto read_range_only_data (boost::filesystem::path dir, const std::string& name)
     {
         boost::filesystem::ofstream controls (dir/name/"controls.txt");
         controls << "# dt, actual v, actual w, actual g, commanded v, commanded w\n";
+        const auto& trajectory = static_cast<const slam_result_impl_type&> (*ground_truth).get_trajectory();
         for (slam::timestep_type t {0}; t < dataset->current_timestep(); ++t) {
             double dt = dataset->timedelta(t);
-            planar_robot::pose pose_delta = ground_truth->get_trajectory()[t];
+            planar_robot::pose pose_delta = trajectory[t];
             auto actual = planar_robot::velocity_slip_model::observe(pose_delta);
             actual /= dt;
             auto commanded = dataset->control(t);
@@ -8,7 +8,9 @@
 #include <random>
 #include <utility>
 #include <algorithm>
+#include <limits>
 #include <cctype>
+#include <cmath>
 
 #include <boost/program_options.hpp>
 #include <boost/filesystem.hpp>
@@ -16,17 +18,25 @@
 
 #include "planar_robot/rms_error.hpp"
 #include "slam/interfaces.hpp"
+#include "slam/latency_stats.hpp"
 #include "slam/slam_result_impl.hpp"
 #include "slam/slam_initialiser.hpp"
 #include "slam/mcmc_slam.hpp"
+#include "slam/mcmc_sample_archive.hpp"
 #include "slam/multi_mcmc.hpp"
 #include "slam/g2o_slam.hpp"
 #include "slam/g2o_clustering.hpp"
+#include "slam/scheduler.hpp"
+#include "slam/submap_slam.hpp"
 #include "slam/slam_likelihood.hpp"
 #include "simulator/simulator.hpp"
 #include "simulator/slam_plotter.hpp"
 #include "simulator/time_series_plotter.hpp"
+#include "utility/counters.hpp"
+#include "utility/log.hpp"
+#include "utility/memory.hpp"
 #include "utility/random.hpp"
+#include "utility/trace.hpp"
 #include "utility/utility.hpp"
 
 #include "main.hpp"
@@ -40,13 +50,29 @@ using slam_data_type = slam::slam_data<control_model_type, observation_model_typ
 using slam_dataset_type = slam::dataset<control_model_type, observation_model_type>;
 using slam_initialiser_type = slam::slam_initialiser<control_model_type, observation_model_type>;
 using mcmc_slam_type = slam::mcmc_slam<control_model_type, observation_model_type>;
+using mcmc_sample_writer_type = slam::mcmc_sample_writer<control_model_type, observation_model_type>;
 using multi_mcmc_type = slam::multi_mcmc<control_model_type, observation_model_type>;
 using g2o_slam_type = slam::g2o_slam<control_model_type, observation_model_type>;
 using g2o_clustering_type = slam::g2o_clustering<control_model_type, observation_model_type>;
+using submap_slam_type = slam::submap_slam<control_model_type, observation_model_type>;
 
 boost::program_options::variables_map parse_options (int argc, char* argv[]);
 
 
+/** The accuracy of one estimator, as printed at the end of a run */
+struct estimator_summary {
+    std::string name;
+    double map_rmse, trajectory_rmse;
+    double aligned_map_rmse, aligned_trajectory_rmse;
+    double log_likelihood_ratio;
+};
+
+void write_stats_json (const boost::program_options::variables_map& options,
+                       const std::vector<estimator_summary>& summaries);
+
+void write_trace (const std::string& file);
+
+
 template <class T>
 T remember_option (boost::program_options::variables_map& options, const std::string& key, T default_value) {
     if (options[key].empty()) {
@@ -67,6 +93,17 @@ int main (int argc, char* argv[]) {
     
     boost::program_options::variables_map options = parse_options (argc, argv);
     
+    utility::log::configure (utility::log::parse_level (options["log-level"].as<std::string>()),
+                             options.count ("log-file") ? options["log-file"].as<std::string>() : std::string());
+    
+    if (options.count ("trace")) {
+#ifdef SLAM_TRACING
+        utility::trace::start();
+#else
+        std::cerr << "Tracing was disabled at compile time; --trace will record no events\n";
+#endif
+    }
+    
     /* set up simulation objects */
     
     random_source random (remember_option(options, "seed", (unsigned int)std::random_device()()));
@@ -76,6 +113,7 @@ int main (int argc, char* argv[]) {
     unsigned int mcmc_slam_seed = remember_option (options, "mcmc-slam-seed", (unsigned int)random());
     unsigned int fastslam_seed = remember_option (options, "fastslam-seed", (unsigned int)random());
     unsigned int multi_mcmc_seed = remember_option (options, "multi-mcmc-seed", (unsigned int)random());
+    unsigned int submap_seed = remember_option (options, "submap-seed", (unsigned int)random());
     
     (void)fastslam_seed;
     
@@ -84,6 +122,12 @@ int main (int argc, char* argv[]) {
     
     auto data = std::make_shared<slam_data_type>();
     
+    std::shared_ptr<slam::latency_stats> latency;
+    if (options.count ("latency")) {
+        latency = std::make_shared<slam::latency_stats> (options);
+        data->set_latency_stats (latency);
+    }
+    
     std::shared_ptr<slam_dataset_type> dataset;
     std::shared_ptr<slam_result_type> ground_truth;
     
@@ -111,6 +155,12 @@ int main (int argc, char* argv[]) {
     auto init = std::make_shared<slam_initialiser_type> (init_seed);
     data->add_listener (init);
     
+    // When enabled, the scheduler drives the estimators in place of their updaters
+    std::shared_ptr<slam::scheduler> scheduler;
+    if (options.count ("scheduler-budget")) {
+        scheduler = std::make_shared<slam::scheduler> (options);
+    }
+    
     std::shared_ptr<mcmc_slam_type> mcmc_slam;
     std::shared_ptr<mcmc_slam_type::updater> mcmc_slam_updater;
     if (options.count ("mcmc-slam")) {
@@ -118,13 +168,52 @@ int main (int argc, char* argv[]) {
         mcmc_slam->set_initialiser (init);
         mcmc_slam_updater = std::make_shared<mcmc_slam_type::updater>(mcmc_slam, options);
         data->add_timestep_listener (mcmc_slam);
-        data->add_timestep_listener (mcmc_slam_updater);
+        if (scheduler) {
+            // The scheduler replaces the updater's time steps, which run the speculative updates
+            if (options["mcmc-speculative-steps"].as<unsigned int>()) {
+                std::cerr << "mcmc-speculative-steps cannot be used with scheduler-budget" << std::endl;
+                std::exit (EXIT_FAILURE);
+            }
+            scheduler->add_task ({
+                "mcmc_slam", options["scheduler-mcmc-priority"].as<double>(),
+                [=](slam::timestep_type t) { mcmc_slam->timestep (t); },
+                [=]() { mcmc_slam_updater->completed(); },
+                [=](unsigned int steps) { return mcmc_slam_updater->run (steps); },
+                [=]() { return mcmc_slam->get_log_likelihood(); }
+            });
+        }
+        else data->add_timestep_listener (mcmc_slam_updater);
+    }
+    
+    std::shared_ptr<mcmc_sample_writer_type> mcmc_archive;
+    if (mcmc_slam && options.count ("mcmc-archive")) {
+        mcmc_archive = std::make_shared<mcmc_sample_writer_type> (options["mcmc-archive"].as<std::string>(),
+                                                                  options["mcmc-archive-key-interval"].as<unsigned int>());
+        // A failed write closes the archive, so it is reported once and sampling carries on
+        mcmc_slam_updater->set_sample_listener ([=](const mcmc_slam_type& sample) {
+            try { mcmc_archive->write (sample); }
+            catch (const std::exception& e) { std::cerr << e.what() << "; later samples are not archived\n"; }
+        }, options["mcmc-archive-thin"].as<unsigned int>());
     }
     
     std::shared_ptr<multi_mcmc_type> multi_mcmc;
     if (options.count ("multi-mcmc")) {
         multi_mcmc = std::make_shared<multi_mcmc_type> (data, options, multi_mcmc_seed);
-        data->add_timestep_listener (multi_mcmc);
+        if (scheduler) {
+            // Chains run in worker processes are left stale here, so they cannot be updated afterwards
+            if (options["multi-mcmc-processes"].as<unsigned int>() > 1 && options["scheduler-end-budget"].as<double>() > 0) {
+                std::cerr << "multi-mcmc-processes cannot be used with scheduler-end-budget" << std::endl;
+                std::exit (EXIT_FAILURE);
+            }
+            scheduler->add_task ({
+                "multi_mcmc", options["scheduler-multi-mcmc-priority"].as<double>(),
+                [=](slam::timestep_type t) { multi_mcmc->timestep (t); },
+                [=]() { multi_mcmc->completed(); },
+                [=](unsigned int steps) { multi_mcmc->update (steps); return steps; },
+                [=]() { return multi_mcmc->get_log_likelihood(); }
+            });
+        }
+        else data->add_timestep_listener (multi_mcmc);
     }
     
     std::shared_ptr<g2o_slam_type> g2o_slam;
@@ -133,9 +222,62 @@ int main (int argc, char* argv[]) {
         g2o_slam = std::make_shared<g2o_slam_type> (init);
         g2o_slam_updater = std::make_shared<g2o_slam_type::updater>(g2o_slam, options);
         data->add_listener (g2o_slam);
-        data->add_timestep_listener (g2o_slam_updater);
+        if (scheduler) {
+            scheduler->add_task ({
+                "g2o_slam", options["scheduler-g2o-priority"].as<double>(),
+                [=](slam::timestep_type t) { g2o_slam->timestep (t); },
+                [=]() { g2o_slam_updater->completed(); },
+                [=](unsigned int iterations) {
+                    // optimise returns -1 on failure, which counts as no work done
+                    const int done = g2o_slam->optimise (int (std::min<unsigned int> (iterations, std::numeric_limits<int>::max())));
+                    return done > 0 ? unsigned (done) : 0u;
+                },
+                [=]() { return g2o_slam->get_log_likelihood(); }
+            });
+        }
+        else data->add_timestep_listener (g2o_slam_updater);
+    }
+    
+    std::shared_ptr<submap_slam_type> submap_slam;
+    if (options.count ("submaps")) {
+        
+        const std::string estimator = options["submap-estimator"].as<std::string>();
+        if (estimator != "mcmc" && estimator != "g2o") {
+            std::cerr << "Unknown submap estimator: " << estimator << std::endl;
+            std::exit (EXIT_FAILURE);
+        }
+        
+        auto make_estimator = [=](const std::shared_ptr<slam_data_type>& submap_data, unsigned int seed) {
+            submap_slam_type::estimator result;
+            auto submap_init = std::make_shared<slam_initialiser_type> (seed);
+            submap_data->add_listener (submap_init);
+            result.listeners.push_back (submap_init);
+            if (estimator == "g2o") {
+                auto submap_g2o = std::make_shared<g2o_slam_type> (submap_init);
+                auto updater = std::make_shared<g2o_slam_type::updater> (submap_g2o, options);
+                submap_data->add_listener (submap_g2o);
+                submap_data->add_timestep_listener (updater);
+                result.listeners.push_back (updater);
+                result.result = submap_g2o;
+            }
+            else {
+                auto submap_mcmc = std::make_shared<mcmc_slam_type> (submap_data, seed);
+                auto updater = std::make_shared<mcmc_slam_type::updater> (submap_mcmc, options);
+                submap_mcmc->set_initialiser (submap_init);
+                submap_data->add_timestep_listener (submap_mcmc);
+                submap_data->add_timestep_listener (updater);
+                result.listeners.push_back (updater);
+                result.result = submap_mcmc;
+            }
+            return result;
+        };
+        
+        submap_slam = std::make_shared<submap_slam_type> (data, make_estimator, options, submap_seed);
+        data->add_listener (submap_slam);
     }
     
+    if (scheduler) data->add_timestep_listener (scheduler);
+    
     std::shared_ptr<g2o_clustering_type> g2o_clustering;
     if (options.count ("cluster")) {
         g2o_clustering = std::make_shared<g2o_clustering_type>(data, init);
@@ -203,23 +345,32 @@ int main (int argc, char* argv[]) {
         if (slam_plot) slam_plot->completed();
     }
     
+    std::vector<estimator_summary> summaries;
+
     const auto print_rmse = [ground_truth](const slam_result_type& estimate, const char* name) {
 
-        double map_rmse, traj_rmse;
+        estimator_summary summary;
+        summary.name = name;
 
-        std::tie(map_rmse, traj_rmse) = planar_robot::map_traj_rmse_align_start (*ground_truth, estimate);
-        std::cout << name << " Map RMSE: " << map_rmse << '\n' << name << " Trajectory RMSE: " << traj_rmse << '\n';
+        std::tie(summary.map_rmse, summary.trajectory_rmse) = planar_robot::map_traj_rmse_align_start (*ground_truth, estimate);
+        std::cout << name << " Map RMSE: " << summary.map_rmse << '\n'
+        << name << " Trajectory RMSE: " << summary.trajectory_rmse << '\n';
 
-        std::tie(map_rmse, traj_rmse) = planar_robot::map_traj_rmse_align_best (*ground_truth, estimate);
-        std::cout << name << " Aligned Map RMSE: " << map_rmse << '\n' << name << " Aligned Trajectory RMSE: " << traj_rmse << '\n';
+        std::tie(summary.aligned_map_rmse, summary.aligned_trajectory_rmse) = planar_robot::map_traj_rmse_align_best (*ground_truth, estimate);
+        std::cout << name << " Aligned Map RMSE: " << summary.aligned_map_rmse << '\n'
+        << name << " Aligned Trajectory RMSE: " << summary.aligned_trajectory_rmse << '\n';
+
+        return summary;
     };
 
     if (mcmc_slam) {
-        print_rmse (*mcmc_slam, "MCMC-SLAM");
+        auto summary = print_rmse (*mcmc_slam, "MCMC-SLAM");
+        summary.log_likelihood_ratio = mcmc_slam->get_log_likelihood() - dataset_log_likelihood;
         std::cout
         << "MCMC-SLAM log likelihood ratio: "
-        << mcmc_slam->get_log_likelihood() - dataset_log_likelihood
+        << summary.log_likelihood_ratio
         << "\n\n";
+        summaries.push_back (summary);
     }
     
     if (multi_mcmc) {
@@ -227,33 +378,55 @@ int main (int argc, char* argv[]) {
         std::cout
         << "Multi-MCMC-SLAM Chains: "
         << multi_mcmc->num_chains() << '\n';
-        print_rmse (*mcmc_slam, "Multi-MCMC");
+        auto summary = print_rmse (*multi_mcmc, "Multi-MCMC");
+        summary.log_likelihood_ratio = multi_mcmc->get_log_likelihood() - dataset_log_likelihood;
         std::cout
         << "Multi-MCMC-SLAM log likelihood ratio: "
-        << multi_mcmc->get_log_likelihood() - dataset_log_likelihood
+        << summary.log_likelihood_ratio
         << "\n\n";
+        summaries.push_back (summary);
         
         auto average = multi_mcmc->get_average();
-        print_rmse (*mcmc_slam, "Averaged-Multi-MCMC");
+        auto average_summary = print_rmse (*average, "Averaged-Multi-MCMC");
+        average_summary.log_likelihood_ratio = slam::slam_log_likelihood (*data, *average) - dataset_log_likelihood;
         std::cout
         << "Averaged-Multi-MCMC log likelihood ratio: "
-        << slam::slam_log_likelihood (*data, *average) - dataset_log_likelihood
+        << average_summary.log_likelihood_ratio
         << "\n\n";        
+        summaries.push_back (average_summary);
     }
     
     if (g2o_slam) {
-        print_rmse(*g2o_slam, "G2O-SLAM");
+        auto summary = print_rmse(*g2o_slam, "G2O-SLAM");
+        summary.log_likelihood_ratio = slam::slam_log_likelihood (*data, *g2o_slam) - dataset_log_likelihood;
         std::cout
         << "G2O-SLAM log likelihood ratio: "
-        << slam::slam_log_likelihood (*data, *g2o_slam) - dataset_log_likelihood
+        << summary.log_likelihood_ratio
+        << "\n\n";
+        summaries.push_back (summary);
+    }
+    
+    if (submap_slam) {
+        std::cout << "Submap-SLAM Submaps: " << submap_slam->num_submaps() << '\n';
+        auto summary = print_rmse (*submap_slam, "Submap-SLAM");
+        summary.log_likelihood_ratio = slam::slam_log_likelihood (*data, *submap_slam) - dataset_log_likelihood;
+        std::cout
+        << "Submap-SLAM log likelihood ratio: "
+        << summary.log_likelihood_ratio
         << "\n\n";
+        summaries.push_back (summary);
     }
     
     if (mcmc_slam && g2o_clustering) {
 
+        SLAM_TRACE_SCOPE ("clustering");
         for (int i = 0; i < 100; ++i) {
-            for (int j = 0; j < 10000; ++j) mcmc_slam->update();
-            std::cout << "Testing candidate cluster " << (i+1) << std::endl;
+            {
+                SLAM_TRACE_SCOPE ("mcmc_slam::update", "steps", 10000);
+                for (int j = 0; j < 10000; ++j) mcmc_slam->update();
+            }
+            SLAM_LOG_INFO ("cluster.candidate", {{"index", i+1}});
+            SLAM_TRACE_SCOPE ("g2o_clustering::add", "cluster", i+1);
             g2o_clustering->add (*mcmc_slam);
         }
         g2o_clustering->sort_clusters();
@@ -285,6 +458,12 @@ int main (int argc, char* argv[]) {
         cluster_plot->completed();
     }
     
+    if (scheduler) scheduler->report (std::cout);
+    if (latency) latency->report (std::cout);
+    if (options.count ("stats-json")) write_stats_json (options, summaries);
+    if (options.count ("trace")) write_trace (options["trace"].as<std::string>());
+    utility::log::flush();
+    
     return EXIT_SUCCESS;
     
 }
@@ -306,17 +485,24 @@ boost::program_options::variables_map parse_options (int argc, char* argv[]) {
     ("output-dir,o", po::value<std::string>()->default_value("output"),
      "directory for simulation output files")
     ("log", "produce detailed simulation logs")
+    ("log-level", po::value<std::string>()->default_value("info"),
+     "least severe diagnostic messages to write (debug, info, warning or error)")
+    ("log-file", po::value<std::string>(), "write diagnostic messages to this file instead of standard error")
     ("mcmc-slam", "enable MCMC-SLAM")
     ("multi-mcmc", "enable Multi-MCMC-SLAM")
     ("fastslam", "enable FastSLAM 2.0")
     ("g2o", "enable offline SLAM using G2O")
+    ("submaps", "enable submap SLAM, solving submaps separately and then aligning them")
     ("cluster", "try to cluster MCMC-SLAM results")
+    ("latency", "record latency histograms of each data event and listener")
     ("slam-plot", "produce SLAM gnuplot output")
     ("plot-stats", "produce plots of various summary statistics")
     ("learn-model", "learn observation and control models")
     ("learn-model-iterations", po::value<unsigned int>()->default_value(5),
      "number of iterations to use when learning control model")
-    ("seed", po::value<unsigned int>(), "seed for global random number generator");
+    ("seed", po::value<unsigned int>(), "seed for global random number generator")
+    ("stats-json", po::value<std::string>(), "write accuracy summaries and hot-path counters to this JSON file at exit")
+    ("trace", po::value<std::string>(), "write a Chrome trace-event timeline of the run to this file at exit");
     
     const std::vector<std::pair<std::string, po::options_description>> module_options {
         { "Simulator", simulator_type::program_options() },
@@ -327,6 +513,9 @@ boost::program_options::variables_map parse_options (int argc, char* argv[]) {
         { "MCMC-SLAM", mcmc_slam_type::program_options() },
         { "Multi-MCMC", multi_mcmc_type::program_options() },
         { "G2O-SLAM", g2o_slam_type::program_options() },
+        { "Scheduler", slam::scheduler::program_options() },
+        { "Submaps", submap_slam_type::program_options() },
+        { "Latency", slam::latency_stats::program_options() },
         { "SLAM plot", slam_plotter::program_options() }
     };
     
@@ -390,6 +579,61 @@ boost::program_options::variables_map parse_options (int argc, char* argv[]) {
 }
 
 
+void write_stats_json (const boost::program_options::variables_map& options,
+                       const std::vector<estimator_summary>& summaries) {
+
+    const std::string& file = options["stats-json"].as<std::string>();
+    std::ofstream out (file);
+    if (!out) {
+        std::cerr << "Could not write statistics file: " << file << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+
+    // JSON has no literals for NaN or infinity
+    const auto field = [&](const char* name, double value) {
+        out << ", \"" << name << "\": ";
+        if (std::isfinite (value)) out << value;
+        else out << "null";
+    };
+
+    out.precision (10);
+    out << "{\n  \"dataset\": "
+    << utility::quoted (options.count ("dataset") ? options["dataset"].as<std::string>() : std::string ("simulated")) << ",\n"
+    << "  \"seed\": " << options["seed"].as<unsigned int>() << ",\n"
+    << "  \"estimators\": [";
+
+    for (std::size_t i = 0; i < summaries.size(); ++i) {
+        const estimator_summary& s = summaries[i];
+        out << (i == 0 ? "\n" : ",\n") << "    { \"name\": " << utility::quoted (s.name);
+        field ("map_rmse", s.map_rmse);
+        field ("trajectory_rmse", s.trajectory_rmse);
+        field ("aligned_map_rmse", s.aligned_map_rmse);
+        field ("aligned_trajectory_rmse", s.aligned_trajectory_rmse);
+        field ("log_likelihood_ratio", s.log_likelihood_ratio);
+        out << " }";
+    }
+
+    out << "\n  ],\n  \"counters\": ";
+    utility::counters::write_json (out);
+    out << ",\n  \"memory\": ";
+    utility::memory::write_json (out);
+    out << "\n}\n";
+}
+
+
+void write_trace (const std::string& file) {
+
+    utility::trace::stop();
+
+    std::ofstream out (file);
+    if (!out) {
+        std::cerr << "Could not write trace file: " << file << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+    utility::trace::write_json (out);
+}
+
+
 void learn_model (const slam_dataset_type& dataset, const slam_result_type& ground_truth,
                   const boost::program_options::variables_map& options) {
     
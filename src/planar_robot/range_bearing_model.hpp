@@ -60,6 +60,14 @@ namespace planar_robot {
             auto likelihood (const result_type& x) const -> double { return model.likelihood (observe (x)); }
             auto log_likelihood (const result_type& x) const -> double { return model.log_likelihood (observe (x)); }
             auto initial_value (random_source&) const -> result_type { return inv_observe (model.mean()); }
+            
+            /** The coordinates in which likelihood is a density */
+            using vector_type = range_bearing_model::vector_type;
+            static auto to_vector (const result_type& x) -> vector_type { return observe (x); }
+            static auto from_vector (const vector_type& v) -> result_type { return inv_observe (v); }
+            static auto subtract (const vector_type& a, const vector_type& b) -> vector_type {
+                return range_bearing_model::subtract (a, b);
+            }
         };
         
         auto proposal () const -> proposal_dist {
@@ -139,6 +147,14 @@ namespace planar_robot {
                 using namespace boost::math::constants;
                 return position::polar (model.mean()(0), random.uniform()*2*pi<double>());
             }
+            
+            /** The coordinates in which likelihood is a density: range and direction */
+            using vector_type = Eigen::Matrix<double, vector_dim, 1>;
+            static auto to_vector (const result_type& x) -> vector_type { return { x.distance(), x.direction() }; }
+            static auto from_vector (const vector_type& v) -> result_type { return position::polar (v(0), v(1)); }
+            static auto subtract (const vector_type& a, const vector_type& b) -> vector_type {
+                return { a(0)-b(0), wrap_angle(a(1)-b(1)) };
+            }
         };
         
         auto proposal () const -> proposal_dist {
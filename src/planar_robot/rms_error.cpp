@@ -10,6 +10,7 @@
 #include <cmath>
 #include <algorithm>
 #include <utility>
+#include <vector>
 
 #include <boost/accumulators/accumulators.hpp>
 #include <boost/accumulators/statistics/stats.hpp>
@@ -21,17 +22,25 @@
 #include "utility/bitree.hpp"
 #include "utility/flat_map.hpp"
 
-double planar_robot::trajectory_rmse (const planar_trajectory& ground_truth,
-                                      const planar_trajectory& estimate,
+double planar_robot::trajectory_rmse (const planar_slam_result& ground_truth,
+                                      const planar_slam_result& estimate,
                                       const pose& initial_state) {
 
-    assert (ground_truth.size() >= estimate.size());
+    assert (ground_truth.current_timestep() >= estimate.current_timestep());
+    
+    const std::size_t size = estimate.current_timestep()+1;
+    std::vector<pose> true_states (size), est_states (size);
+    ground_truth.export_states (slam::timestep_type(0), slam::timestep_type(size), true_states.data());
+    estimate.export_states (slam::timestep_type(0), slam::timestep_type(size), est_states.data());
+    
+    const pose true_origin = -ground_truth.get_initial_state();
+    const pose est_origin = initial_state + (-estimate.get_initial_state());
     
     using namespace boost::accumulators;
     accumulator_set<double, stats<tag::mean>> acc;
     
-    for (std::size_t t = 0; t <= estimate.size(); ++t) {
-        acc ((-ground_truth.accumulate(t) + (initial_state + estimate.accumulate(t))).distance_squared());
+    for (std::size_t t = 0; t < size; ++t) {
+        acc ((-(true_origin + true_states[t]) + (est_origin + est_states[t])).distance_squared());
     }
 
     return std::sqrt (mean (acc));
@@ -62,7 +71,7 @@ std::pair<double, double> planar_robot::map_traj_rmse (const planar_slam_result&
                                                        const planar_slam_result& estimate) {
     
     double map = map_rmse(ground_truth.get_feature_map(), estimate.get_feature_map(), pose());
-    double traj = trajectory_rmse(ground_truth.get_trajectory(), estimate.get_trajectory(),
+    double traj = trajectory_rmse(ground_truth, estimate,
                                   -ground_truth.get_initial_state() + estimate.get_initial_state());
     return std::make_pair(map, traj);
 }
@@ -73,7 +82,7 @@ std::pair<double, double> planar_robot::map_traj_rmse_align_start (const planar_
     
     double map = map_rmse(ground_truth.get_feature_map(), estimate.get_feature_map(),
                           ground_truth.get_initial_state());
-    double traj = trajectory_rmse(ground_truth.get_trajectory(), estimate.get_trajectory(), pose());
+    double traj = trajectory_rmse(ground_truth, estimate, pose());
     return std::make_pair(map, traj);
 }
 
@@ -84,7 +93,7 @@ std::pair<double, double> planar_robot::map_traj_rmse_align_best (const planar_s
     pose isometry = estimate_initial_pose(ground_truth.get_feature_map(), estimate.get_feature_map());
     
     double map = map_rmse(ground_truth.get_feature_map(), estimate.get_feature_map(), isometry);
-    double traj = trajectory_rmse(ground_truth.get_trajectory(), estimate.get_trajectory(),
+    double traj = trajectory_rmse(ground_truth, estimate,
                                   -ground_truth.get_initial_state() + isometry + estimate.get_initial_state());
     return std::make_pair(map, traj);
 }
@@ -106,19 +115,22 @@ auto planar_robot::estimate_initial_pose (const planar_map& ground_truth,
         features_vec.emplace_back(landmark.second, estimate->second);
     }
     
-    Eigen::Matrix2Xd landmarks(2,features_vec.size());
-    Eigen::Matrix2Xd est_landmarks(2,features_vec.size());
-    for (std::size_t i = 0; i < features_vec.size(); ++i) {
-        landmarks.col(i) = features_vec[i].first.to_vector();
-        est_landmarks.col(i) = features_vec[i].second.to_vector();
-    }
-    
-    const Eigen::Isometry2d isometry {Eigen::umeyama(est_landmarks, landmarks, false)};
-    return pose::from_trans_rot(isometry.translation(),
-                                Eigen::Rotation2Dd(0).fromRotationMatrix(isometry.linear()));
+    return align_points (features_vec);
 }
 
 
+auto planar_robot::align_points (const std::vector<std::pair<position, position>>& pairs) -> pose {
 
+    assert (pairs.size() >= 2);
 
-
+    Eigen::Matrix2Xd targets (2, pairs.size());
+    Eigen::Matrix2Xd sources (2, pairs.size());
+    for (std::size_t i = 0; i < pairs.size(); ++i) {
+        targets.col(i) = pairs[i].first.to_vector();
+        sources.col(i) = pairs[i].second.to_vector();
+    }
+    
+    const Eigen::Isometry2d isometry {Eigen::umeyama(sources, targets, false)};
+    return pose::from_trans_rot(isometry.translation(),
+                                Eigen::Rotation2Dd(0).fromRotationMatrix(isometry.linear()));
+}
@@ -10,6 +10,7 @@
 #define _PLANAR_ROBOT_RMS_ERROR_HPP
 
 #include <utility>
+#include <vector>
 
 #include "planar_robot/pose.hpp"
 #include "planar_robot/position.hpp"
@@ -22,8 +23,10 @@ namespace planar_robot {
     using planar_trajectory = planar_slam_result::trajectory_type;
     using planar_map = planar_slam_result::feature_map_type;
 
-    double trajectory_rmse (const planar_trajectory& ground_truth,
-                            const planar_trajectory& estimate, const pose& initial_state);
+    /** Compares the estimated states, relative to its initial state and then offset by
+     ** initial_state, with the ground truth states relative to its initial state. */
+    double trajectory_rmse (const planar_slam_result& ground_truth,
+                            const planar_slam_result& estimate, const pose& initial_state);
 
     double map_rmse (const planar_map& ground_truth,
                      const planar_map& estimates, const pose& origin);
@@ -38,6 +41,10 @@ namespace planar_robot {
                                                         const planar_slam_result& estimate);
 
     pose estimate_initial_pose (const planar_map& ground_truth, const planar_map& estimates);
+
+    /** The rigid transformation p minimising the squared distances between each pair's first
+     position and p + its second position. Needs at least two pairs. */
+    pose align_points (const std::vector<std::pair<position, position>>& pairs);
     
 }
 
@@ -77,6 +77,14 @@ namespace planar_robot {
             auto likelihood (const result_type& x) const -> double { return model.likelihood (observe (x)); }
             auto log_likelihood (const result_type& x) const -> double { return model.log_likelihood (observe (x)); }
             auto initial_value (random_source&) const -> result_type { return inv_observe (model.mean()); }
+            
+            /** The coordinates in which likelihood is a density */
+            using vector_type = velocity_slip_model::vector_type;
+            static auto to_vector (const result_type& x) -> vector_type { return observe (x); }
+            static auto from_vector (const vector_type& v) -> result_type { return inv_observe (v); }
+            static auto subtract (const vector_type& a, const vector_type& b) -> vector_type {
+                return velocity_slip_model::subtract (a, b);
+            }
         };
         
         auto proposal () const -> proposal_dist {
@@ -149,6 +157,14 @@ namespace planar_robot {
             auto likelihood (const result_type& x) const -> double { return model.likelihood (observe (x)); }
             auto log_likelihood (const result_type& x) const -> double { return model.log_likelihood (observe (x)); }
             auto initial_value (random_source&) const -> result_type { return inv_observe (model.mean()); }
+            
+            /** The coordinates in which likelihood is a density */
+            using vector_type = velocity_model::vector_type;
+            static auto to_vector (const result_type& x) -> vector_type { return observe (x); }
+            static auto from_vector (const vector_type& v) -> result_type { return inv_observe (v); }
+            static auto subtract (const vector_type& a, const vector_type& b) -> vector_type {
+                return velocity_model::subtract (a, b);
+            }
         };
         
         auto proposal () const -> proposal_dist {
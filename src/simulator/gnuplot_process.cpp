@@ -7,24 +7,58 @@
 //
 
 #include <cassert>
+#include <cstdarg>
+#include <utility>
 #include <stdio.h>
 
 #include "gnuplot_process.hpp"
+#include "utility/trace.hpp"
 
-gnuplot_process::gnuplot_process (bool debug) : debug_mode(debug) {
+gnuplot_process::gnuplot_process (bool debug, frame_policy policy) : debug_mode(debug), policy(policy) {
     if (!debug_mode) fh = popen ("gnuplot -p", "w");
     else fh = fopen ("debug-gnuplot.txt", "w");
+    render_thread = std::thread (&gnuplot_process::render_loop, this);
 }
 
 gnuplot_process::~gnuplot_process () {
+    {
+        std::lock_guard<std::mutex> lock (pending_mutex);
+        stopping = true;
+    }
+    frame_ready.notify_one();
+    render_thread.join();
+    
     if (fh) {
+        if (!current.commands.empty()) std::fputs (current.commands.c_str(), fh);
         if (!debug_mode) pclose (fh);
         else fclose (fh);
     }
 }
 
+int gnuplot_process::printf (const char* format, ...) {
+    
+    std::va_list args;
+    va_start (args, format);
+    std::va_list args_copy;
+    va_copy (args_copy, args);
+    const int length = std::vsnprintf (nullptr, 0, format, args_copy);
+    va_end (args_copy);
+    
+    if (length > 0) {
+        std::string& buffer = command_buffer();
+        const size_t start = buffer.size();
+        buffer.resize (start + length + 1);
+        std::vsnprintf (&buffer[start], length + 1, format, args);
+        buffer.resize (start + length);
+    }
+    
+    va_end (args);
+    return length;
+}
+
 void gnuplot_process::plot (size_t columns) {
 
+    auto& buffer = current.data;
     assert (buffer.size() >= buffer_queued);
     assert ((buffer.size() - buffer_queued) % columns == 0);
 
@@ -33,37 +67,81 @@ void gnuplot_process::plot (size_t columns) {
 
     if (records > 0) {
 
-        if (!plot_started) { puts ("plot "); plot_started = true; }
+        if (!plot_started) { plot_started = true; puts ("plot "); }
         else puts (", ");        
         
-        if (columns > 1) std::fprintf (fh, "'-' binary record=%zu format='%%%zufloat' ", records, columns);
-        else std::fprintf (fh, "'-' binary array=%zu format='%%float' ", records);
+        if (columns > 1) printf ("'-' binary record=%zu format='%%%zufloat' ", records, columns);
+        else printf ("'-' binary array=%zu format='%%float' ", records);
     }
 }
 
 
 void gnuplot_process::plot () {
     
-    puts ("\n");
+    current.plot_command += "\n";
+    current.data.resize (buffer_queued);
     plot_started = false;
+    buffer_queued = 0;
+    
+    {
+        std::lock_guard<std::mutex> lock (pending_mutex);
+        if (policy == latest_only && !pending.empty()) {
+            // Drop the unrendered frame but keep its setup commands, which may not be repeated
+            current.commands.insert (0, pending.back().commands);
+            pending.pop_back();
+        }
+        pending.push_back (std::move (current));
+    }
+    frame_ready.notify_one();
+    
+    current = frame();
+}
+
+
+void gnuplot_process::render_loop () {
+    
+    SLAM_TRACE_THREAD ("gnuplot");
+    std::unique_lock<std::mutex> lock (pending_mutex);
+    
+    while (true) {
+        
+        frame_ready.wait (lock, [this] { return stopping || !pending.empty(); });
+        if (pending.empty()) return;
+        
+        frame f = std::move (pending.front());
+        pending.pop_front();
+        
+        lock.unlock();
+        if (fh) write_frame (f);
+        lock.lock();
+    }
+}
+
+
+void gnuplot_process::write_frame (const frame& f) {
+    
+    SLAM_TRACE_SCOPE ("gnuplot_process::write_frame");
+    std::fputs (f.commands.c_str(), fh);
+    std::fputs (f.plot_command.c_str(), fh);
     
-    const float* data = buffer.data();
+    const float* data = f.data.data();
+    size_t remaining = f.data.size();
     
     if (!debug_mode) {
-        while (buffer_queued > 0) {
-            size_t written = std::fwrite (data, sizeof(*data), buffer_queued, fh);
+        while (remaining > 0) {
+            size_t written = std::fwrite (data, sizeof(*data), remaining, fh);
+            if (written == 0) break;
             data += written;
-            buffer_queued -= written;
+            remaining -= written;
         }
     } else {
         size_t line_number = 0;
-        while (buffer_queued > 0) {
+        while (remaining > 0) {
             std::fprintf(fh, "%4zu: %f\n", ++line_number, *data);
             ++data;
-            --buffer_queued;
+            --remaining;
         }
     }
     
-    buffer.clear();
     fflush (fh);
 }
@@ -11,29 +11,65 @@
 
 #include <cstdio>
 #include <vector>
+#include <string>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 
+/** Commands and data are collected into frames, one per call to plot(), which are written to
+ gnuplot by a background thread so that a slow gnuplot never blocks the caller. */
+
 class gnuplot_process {
     
+public:
+    
+    /** With latest_only, a frame still waiting to be written when the next one is submitted is
+     dropped (its setup commands are kept). Use lossless when every frame must be rendered, such
+     as when writing image files. */
+    enum frame_policy { lossless, latest_only };
+    
+private:
+    
+    struct frame {
+        std::string commands;
+        std::string plot_command;
+        std::vector<float> data;
+    };
+    
     FILE* fh;
-    std::vector<float> buffer;
+    
+    frame current;
     size_t buffer_queued = 0;
     
     bool plot_started = false;
     const bool debug_mode;
+    const frame_policy policy;
+    
+    std::deque<frame> pending;
+    bool stopping = false;
+    std::mutex pending_mutex;
+    std::condition_variable frame_ready;
+    std::thread render_thread;
+    
+    void render_loop ();
+    void write_frame (const frame&);
+    
+    std::string& command_buffer () { return plot_started ? current.plot_command : current.commands; }
     
 public:
     
-    gnuplot_process (bool debug = false);
+    gnuplot_process (bool debug = false, frame_policy policy = lossless);
     gnuplot_process (const gnuplot_process&) = delete;
     gnuplot_process& operator= (const gnuplot_process&) = delete;
     virtual ~gnuplot_process ();
     
-    FILE* handle () { return fh; }
+    gnuplot_process& operator<< (float x) { current.data.push_back(x); return *this; }
     
-    gnuplot_process& operator<< (float x) { buffer.push_back(x); return *this; }
+    int puts (const char* str) { command_buffer() += str; return 0; }
     
-    int puts (const char* str) { return std::fputs (str, fh); }
+    int printf (const char* format, ...) __attribute__ ((format (printf, 2, 3)));
     
     void plot (size_t columns);
     void plot ();
@@ -0,0 +1,272 @@
+#include <cmath>
+#include <cstdio>
+#include <array>
+#include <memory>
+#include <algorithm>
+
+#include "simulator/raster_image.hpp"
+#include "utility/utility.hpp"
+
+
+const raster_image::colour raster_image::white = { 255, 255, 255 };
+const raster_image::colour raster_image::black = { 0, 0, 0 };
+
+
+auto raster_image::from_name (const std::string& name, colour fallback) -> colour {
+    
+    static const std::pair<const char*, colour> names[] = {
+        { "black", { 0, 0, 0 } }, { "white", { 255, 255, 255 } }, { "gray", { 160, 160, 160 } },
+        { "grey", { 160, 160, 160 } }, { "red", { 255, 0, 0 } }, { "green", { 0, 160, 0 } },
+        { "blue", { 0, 0, 255 } }, { "cyan", { 0, 200, 200 } }, { "magenta", { 200, 0, 200 } },
+        { "yellow", { 220, 200, 0 } }
+    };
+    
+    for (const auto& entry : names) {
+        if (name == entry.first) return entry.second;
+    }
+    return fallback;
+}
+
+
+raster_image::raster_image (int width, int height, colour background)
+: m_width(width), m_height(height), pixels(3 * std::size_t(width) * height)
+{
+    for (std::size_t i = 0; i < pixels.size(); i += 3) {
+        pixels[i] = background.r;
+        pixels[i+1] = background.g;
+        pixels[i+2] = background.b;
+    }
+}
+
+
+void raster_image::fill_square (int x, int y, int radius, colour c) {
+    for (int j = y - radius; j <= y + radius; ++j) {
+        for (int i = x - radius; i <= x + radius; ++i) set_pixel (i, j, c);
+    }
+}
+
+
+void raster_image::draw_line (double x0, double y0, double x1, double y1, int thickness, colour c) {
+    
+    // Skip lines that lie entirely outside the image
+    const double margin = thickness;
+    if (std::max (x0, x1) < -margin || std::min (x0, x1) > m_width + margin
+        || std::max (y0, y1) < -margin || std::min (y0, y1) > m_height + margin) return;
+    
+    const int radius = thickness / 2;
+    const double steps = std::ceil (std::max (std::abs (x1 - x0), std::abs (y1 - y0)));
+    
+    if (!(steps >= 1)) {
+        fill_square (int (std::lround (x0)), int (std::lround (y0)), radius, c);
+        return;
+    }
+    
+    const double dx = (x1 - x0) / steps, dy = (y1 - y0) / steps;
+    for (int i = 0; i <= steps; ++i) {
+        fill_square (int (std::lround (x0 + i*dx)), int (std::lround (y0 + i*dy)), radius, c);
+    }
+}
+
+
+void raster_image::draw_circle (double x, double y, double radius, colour c) {
+    const int segments = std::max (8, int (4 * radius));
+    for (int i = 0; i < segments; ++i) {
+        const double a0 = 2 * M_PI * i / segments, a1 = 2 * M_PI * (i+1) / segments;
+        draw_line (x + radius*std::cos(a0), y + radius*std::sin(a0),
+                   x + radius*std::cos(a1), y + radius*std::sin(a1), 1, c);
+    }
+}
+
+
+void raster_image::draw_arrow (double x, double y, double dx, double dy, double head_size,
+                               int thickness, colour c) {
+    
+    const double length = std::sqrt (dx*dx + dy*dy);
+    if (!(length > 0)) return;
+    
+    const double ux = dx / length, uy = dy / length;
+    const double tip_x = x + dx, tip_y = y + dy;
+    
+    draw_line (x, y, tip_x, tip_y, thickness, c);
+    
+    // Two barbs at +-30 degrees from the reversed direction
+    const double cos_a = std::cos (M_PI/6), sin_a = std::sin (M_PI/6);
+    draw_line (tip_x, tip_y, tip_x - head_size*(ux*cos_a - uy*sin_a),
+               tip_y - head_size*(uy*cos_a + ux*sin_a), thickness, c);
+    draw_line (tip_x, tip_y, tip_x - head_size*(ux*cos_a + uy*sin_a),
+               tip_y - head_size*(uy*cos_a - ux*sin_a), thickness, c);
+}
+
+
+bool raster_image::write_ppm (const std::string& filename) const {
+    
+    auto file = utility::open_file (filename.c_str(), "wb");
+    if (!file) return false;
+    
+    std::fprintf (file.get(), "P6\n%d %d\n255\n", m_width, m_height);
+    return std::fwrite (pixels.data(), 1, pixels.size(), file.get()) == pixels.size();
+}
+
+
+namespace {
+    
+    /** CRC-32 as used by PNG chunks */
+    
+    std::uint32_t crc32 (const std::uint8_t* data, std::size_t size, std::uint32_t crc = 0) {
+        
+        static const std::array<std::uint32_t, 256> table = [] {
+            std::array<std::uint32_t, 256> t;
+            for (std::uint32_t n = 0; n < 256; ++n) {
+                std::uint32_t c = n;
+                for (int k = 0; k < 8; ++k) c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+                t[n] = c;
+            }
+            return t;
+        }();
+        
+        crc = ~crc;
+        for (std::size_t i = 0; i < size; ++i) crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+        return ~crc;
+    }
+    
+    
+    /** Writes a raw deflate stream using the fixed Huffman code. The only matches emitted are
+     repeats of the previous pixel (distance 3), which is all a plot with large flat areas needs. */
+    
+    class deflate_writer {
+        
+        std::vector<std::uint8_t>& out;
+        std::uint32_t bit_buffer = 0;
+        int bit_count = 0;
+        
+        void put_bits (std::uint32_t value, int count) {
+            bit_buffer |= value << bit_count;
+            bit_count += count;
+            while (bit_count >= 8) {
+                out.push_back (std::uint8_t (bit_buffer));
+                bit_buffer >>= 8;
+                bit_count -= 8;
+            }
+        }
+        
+        // Huffman codes are packed starting from their most significant bit
+        void put_code (std::uint32_t code, int length) {
+            std::uint32_t reversed = 0;
+            for (int i = 0; i < length; ++i) reversed |= ((code >> i) & 1) << (length - 1 - i);
+            put_bits (reversed, length);
+        }
+        
+        void put_symbol (int symbol) {
+            if (symbol < 144) put_code (0x30 + symbol, 8);
+            else if (symbol < 256) put_code (0x190 + symbol - 144, 9);
+            else if (symbol < 280) put_code (symbol - 256, 7);
+            else put_code (0xc0 + symbol - 280, 8);
+        }
+        
+        void put_match (int length) {
+            
+            static const int base[] = {
+                3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+            };
+            static const int extra[] = {
+                0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+            };
+            
+            int code = 28;
+            while (base[code] > length) --code;
+            put_symbol (257 + code);
+            put_bits (length - base[code], extra[code]);
+            put_code (2, 5); // Distance code 2 is distance 3, with no extra bits
+        }
+        
+    public:
+        
+        explicit deflate_writer (std::vector<std::uint8_t>& out) : out(out) { }
+        
+        void write (const std::uint8_t* data, std::size_t size) {
+            
+            put_bits (1, 1); // Final block
+            put_bits (1, 2); // Fixed Huffman codes
+            
+            std::size_t i = 0;
+            while (i < size) {
+                std::size_t length = 0;
+                if (i >= 3) {
+                    while (length < 258 && i + length < size && data[i+length] == data[i+length-3]) ++length;
+                }
+                if (length >= 3) {
+                    put_match (int (length));
+                    i += length;
+                }
+                else put_symbol (data[i++]);
+            }
+            
+            put_symbol (256);
+            if (bit_count > 0) put_bits (0, 8 - bit_count);
+        }
+    };
+    
+    
+    void put_u32 (std::vector<std::uint8_t>& out, std::uint32_t value) {
+        out.push_back (std::uint8_t (value >> 24));
+        out.push_back (std::uint8_t (value >> 16));
+        out.push_back (std::uint8_t (value >> 8));
+        out.push_back (std::uint8_t (value));
+    }
+    
+    
+    void put_chunk (std::vector<std::uint8_t>& out, const char* type, const std::vector<std::uint8_t>& data) {
+        put_u32 (out, std::uint32_t (data.size()));
+        const std::size_t start = out.size();
+        out.insert (out.end(), type, type + 4);
+        out.insert (out.end(), data.begin(), data.end());
+        put_u32 (out, crc32 (&out[start], out.size() - start));
+    }
+    
+}
+
+
+bool raster_image::write_png (const std::string& filename) const {
+    
+    // Raw scanlines, each preceded by filter type 0
+    
+    const std::size_t stride = 3 * std::size_t(m_width);
+    std::vector<std::uint8_t> scanlines;
+    scanlines.reserve ((stride + 1) * m_height);
+    
+    for (int y = 0; y < m_height; ++y) {
+        scanlines.push_back (0);
+        scanlines.insert (scanlines.end(), &pixels[y*stride], &pixels[y*stride] + stride);
+    }
+    
+    // zlib stream: header, deflate data, Adler-32 checksum
+    
+    std::vector<std::uint8_t> compressed = { 0x78, 0x01 };
+    deflate_writer (compressed).write (scanlines.data(), scanlines.size());
+    
+    std::uint32_t a = 1, b = 0;
+    for (auto byte : scanlines) {
+        a = (a + byte) % 65521;
+        b = (b + a) % 65521;
+    }
+    put_u32 (compressed, (b << 16) | a);
+    
+    // PNG signature and chunks
+    
+    std::vector<std::uint8_t> png = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    
+    std::vector<std::uint8_t> header;
+    put_u32 (header, std::uint32_t (m_width));
+    put_u32 (header, std::uint32_t (m_height));
+    header.insert (header.end(), { 8, 2, 0, 0, 0 }); // 8-bit RGB, no interlacing
+    
+    put_chunk (png, "IHDR", header);
+    put_chunk (png, "IDAT", compressed);
+    put_chunk (png, "IEND", {});
+    
+    auto file = utility::open_file (filename.c_str(), "wb");
+    if (!file) return false;
+    return std::fwrite (png.data(), 1, png.size(), file.get()) == png.size();
+}
@@ -0,0 +1,52 @@
+#ifndef slam_raster_image_hpp
+#define slam_raster_image_hpp
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <string>
+
+
+/** A minimal RGB software raster with just enough primitives to draw SLAM plots, and
+ self-contained PNG and PPM writers. Coordinates are in pixels with the origin at the top left. */
+
+class raster_image {
+    
+public:
+    
+    struct colour {
+        std::uint8_t r, g, b;
+    };
+    
+    static const colour white, black;
+    
+    /** Looks up one of the colour names used in gnuplot styles, such as 'blue' or 'gray'. */
+    static colour from_name (const std::string& name, colour fallback = black);
+    
+    raster_image (int width, int height, colour background = white);
+    
+    int width () const { return m_width; }
+    int height () const { return m_height; }
+    
+    void set_pixel (int x, int y, colour c) {
+        if (x < 0 || y < 0 || x >= m_width || y >= m_height) return;
+        auto p = &pixels[3 * (std::size_t(y) * m_width + x)];
+        p[0] = c.r; p[1] = c.g; p[2] = c.b;
+    }
+    
+    void fill_square (int x, int y, int radius, colour);
+    void draw_line (double x0, double y0, double x1, double y1, int thickness, colour);
+    void draw_circle (double x, double y, double radius, colour);
+    void draw_arrow (double x, double y, double dx, double dy, double head_size, int thickness, colour);
+    
+    bool write_ppm (const std::string& filename) const;
+    bool write_png (const std::string& filename) const;
+    
+private:
+    
+    int m_width, m_height;
+    std::vector<std::uint8_t> pixels;
+    
+};
+
+#endif
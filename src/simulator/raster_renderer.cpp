@@ -0,0 +1,122 @@
+#include <cmath>
+#include <limits>
+#include <utility>
+#include <iostream>
+#include <algorithm>
+
+#include "simulator/raster_renderer.hpp"
+#include "utility/trace.hpp"
+
+
+raster_renderer::raster_renderer (int width, int height, image_format format, unsigned int num_threads)
+: width(width), height(height), m_format(format)
+{
+    if (num_threads == 0) num_threads = std::max (1u, std::thread::hardware_concurrency());
+    for (unsigned int i = 0; i < num_threads; ++i) {
+        workers.emplace_back (&raster_renderer::worker_loop, this);
+    }
+}
+
+
+raster_renderer::~raster_renderer () {
+    {
+        std::lock_guard<std::mutex> lock (pending_mutex);
+        stopping = true;
+    }
+    frame_ready.notify_all();
+    for (auto& worker : workers) worker.join();
+}
+
+
+void raster_renderer::submit (frame&& f) {
+    {
+        std::lock_guard<std::mutex> lock (pending_mutex);
+        pending.push_back (std::move (f));
+    }
+    frame_ready.notify_one();
+}
+
+
+void raster_renderer::worker_loop () {
+    
+    SLAM_TRACE_THREAD ("raster_renderer");
+    std::unique_lock<std::mutex> lock (pending_mutex);
+    
+    while (true) {
+        
+        frame_ready.wait (lock, [this] { return stopping || !pending.empty(); });
+        if (pending.empty()) return;
+        
+        frame f = std::move (pending.front());
+        pending.pop_front();
+        
+        lock.unlock();
+        render (f);
+        lock.lock();
+    }
+}
+
+
+void raster_renderer::render (const frame& f) const {
+    
+    SLAM_TRACE_SCOPE ("raster_renderer::render");
+    // Bounding box of the autoscaled layers, with the same offsets as the gnuplot plots
+    
+    double xmin = std::numeric_limits<double>::infinity(), xmax = -xmin;
+    double ymin = xmin, ymax = xmax;
+    
+    auto extend = [&](const std::vector<float>& points) {
+        for (std::size_t i = 0; i + 1 < points.size(); i += 2) {
+            xmin = std::min<double> (xmin, points[i]);
+            xmax = std::max<double> (xmax, points[i]);
+            ymin = std::min<double> (ymin, points[i+1]);
+            ymax = std::max<double> (ymax, points[i+1]);
+        }
+    };
+    
+    for (const auto& l : f.layers) {
+        if (!l.autoscale) continue;
+        extend (l.landmarks);
+        extend (l.trajectory);
+    }
+    
+    if (!(xmin <= xmax && ymin <= ymax)) {
+        xmin = ymin = -1;
+        xmax = ymax = 1;
+    }
+    
+    const double xrange = std::max (xmax - xmin, 1.0), yrange = std::max (ymax - ymin, 1.0);
+    xmin -= 0.2 * xrange; xmax += 0.05 * xrange;
+    ymin -= 0.05 * yrange; ymax += 0.05 * yrange;
+    
+    // Equal scale on both axes, centred in the image
+    
+    const double scale = std::min (width / (xmax - xmin), height / (ymax - ymin));
+    const double xoffset = 0.5 * (width - scale * (xmax - xmin)) - scale * xmin;
+    const double yoffset = 0.5 * (height - scale * (ymax - ymin)) + scale * ymax;
+    
+    auto px = [&](double x) { return xoffset + scale * x; };
+    auto py = [&](double y) { return yoffset - scale * y; };
+    
+    raster_image image (width, height);
+    
+    for (const auto& l : f.layers) {
+        
+        for (std::size_t i = 0; i + 1 < l.landmarks.size(); i += 2) {
+            image.draw_circle (px (l.landmarks[i]), py (l.landmarks[i+1]), 4, l.landmark_colour);
+        }
+        
+        for (std::size_t i = 2; i + 1 < l.trajectory.size(); i += 2) {
+            image.draw_line (px (l.trajectory[i-2]), py (l.trajectory[i-1]),
+                             px (l.trajectory[i]), py (l.trajectory[i+1]), 2, l.trajectory_colour);
+        }
+        
+        const double arrow_length = 1.0 * scale;
+        image.draw_arrow (px (l.state_x), py (l.state_y),
+                          arrow_length * std::cos (l.state_bearing), -arrow_length * std::sin (l.state_bearing),
+                          std::max (6.0, 0.3 * arrow_length), 2, l.state_colour);
+    }
+    
+    const bool written = m_format == png ? image.write_png (f.filename) : image.write_ppm (f.filename);
+    if (!written) std::cerr << "Could not write plot frame " << f.filename << '\n';
+}
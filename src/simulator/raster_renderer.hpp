@@ -0,0 +1,62 @@
+#ifndef slam_raster_renderer_hpp
+#define slam_raster_renderer_hpp
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "simulator/raster_image.hpp"
+
+
+/** Renders SLAM plot frames to image files without spawning gnuplot. Frames are plain
+ snapshots of the plotted geometry, so they are rendered and encoded by a pool of worker
+ threads, in parallel with each other and with the caller. Every submitted frame is written. */
+
+class raster_renderer {
+    
+public:
+    
+    enum image_format { png, ppm };
+    
+    struct layer {
+        std::vector<float> landmarks;   // x, y pairs
+        std::vector<float> trajectory;  // x, y pairs
+        float state_x, state_y, state_bearing;
+        raster_image::colour landmark_colour, trajectory_colour, state_colour;
+        bool autoscale;
+    };
+    
+    struct frame {
+        std::string filename;
+        std::vector<layer> layers;
+    };
+    
+    raster_renderer (int width, int height, image_format, unsigned int num_threads);
+    raster_renderer (const raster_renderer&) = delete;
+    raster_renderer& operator= (const raster_renderer&) = delete;
+    ~raster_renderer ();
+    
+    auto format () const -> image_format { return m_format; }
+    auto extension () const -> const char* { return m_format == png ? ".png" : ".ppm"; }
+    
+    void submit (frame&&);
+    
+private:
+    
+    const int width, height;
+    const image_format m_format;
+    
+    std::deque<frame> pending;
+    bool stopping = false;
+    std::mutex pending_mutex;
+    std::condition_variable frame_ready;
+    std::vector<std::thread> workers;
+    
+    void worker_loop ();
+    void render (const frame&) const;
+};
+
+#endif
@@ -86,7 +86,7 @@ simulator<ControlModel, ObservationModel, Controller, Sensor>
         this->add_control (dt, control);
 
         state += control_model_builder(control, dt).proposal()(random);
-        this->get_trajectory().push_back_accumulated (state);
+        this->append_accumulated_state (state);
         
         if (this->current_timestep() % sensor_skip == 0) sense();
     }
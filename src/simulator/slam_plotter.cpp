@@ -18,6 +18,7 @@
 #include "planar_robot/rms_error.hpp"
 #include "utility/bitree.hpp"
 #include "utility/flat_map.hpp"
+#include "utility/trace.hpp"
 #include "utility/utility.hpp"
 
 
@@ -32,67 +33,145 @@ void slam_plotter::add_data_source (std::shared_ptr<slam_result_type> source, bo
 {
     data_sources.push_back ({
         source, autoscale_map, trajectory_title, landmark_title,
-        feature_point_style, trajectory_line_style, state_arrow_style
+        feature_point_style, trajectory_line_style, state_arrow_style,
+        {}, slam_result_type::unknown_revision
     });
 }
 
 
 void slam_plotter::timestep (slam::timestep_type t) {
+    SLAM_TRACE_SCOPE ("slam_plotter::timestep", "timestep", t);
+    std::ostringstream output_filename;
+    output_filename << std::setfill('0') << std::setw(6) << std::size_t(t);
+    if (raster) {
+        output_filename << raster->extension();
+        plot_raster (t, output_dir.get_value_or(".")/output_filename.str());
+        return;
+    }
     if (output_dir) {
-        std::ostringstream output_filename;
-        output_filename << std::setfill('0') << std::setw(6) << std::size_t(t) << ".png";
+        output_filename << ".png";
         boost::filesystem::path output_file = (*output_dir)/output_filename.str();
-        std::fprintf (gnuplot.handle(), "set output '%s'\n", output_file.c_str());
+        gnuplot->printf ("set output '%s'\n", output_file.c_str());
     }
     plot(t);
 }
 
 
 void slam_plotter::completed () {
+    SLAM_TRACE_SCOPE ("slam_plotter::completed");
+    if (raster) {
+        plot_raster ({}, output_dir.get_value_or(".")/(std::string("final")+raster->extension()));
+        return;
+    }
     if (output_dir) {
         boost::filesystem::path output_file = (*output_dir)/"final.png";
-        std::fprintf (gnuplot.handle(), "set output '%s'\n", output_file.c_str());
+        gnuplot->printf ("set output '%s'\n", output_file.c_str());
     }
     plot();
 }
 
 
+auto slam_plotter::source_origin (const data_source& source) const -> pose {
+    pose origin;
+    if (ground_truth && source.source != ground_truth) {
+        if (match_ground_truth && source.source->get_feature_map().size() >= 2) {
+            origin = planar_robot::estimate_initial_pose(ground_truth->get_feature_map(),
+                                                         source.source->get_feature_map());
+        }
+        else {
+            origin = ground_truth->get_initial_state() + (-source.source->get_initial_state());
+        }
+    }
+    return origin;
+}
+
+
 void slam_plotter::plot (boost::optional<slam::timestep_type> timestep) {
     
-    if (!title.empty()) std::fprintf (gnuplot.handle(), "set title '%s'\n", title.c_str());
-    else gnuplot.puts ("set title\n");
+    if (raster) {
+        plot_raster (timestep, output_dir.get_value_or(".")/(std::string("plot")+raster->extension()));
+        return;
+    }
     
-    //gnuplot.puts ("set key on inside center bottom horizontal Left reverse\n");
-    gnuplot.puts ("set key on inside left top vertical Left reverse\n");
-    gnuplot.puts ("set size ratio -1\n");
-    gnuplot.puts ("set auto fix\n");
-    gnuplot.puts ("set offsets graph 0.2, graph 0.05, graph 0.05, graph 0.05\n");
+    if (!title.empty()) gnuplot->printf ("set title '%s'\n", title.c_str());
+    else gnuplot->puts ("set title\n");
+    
+    //gnuplot->puts ("set key on inside center bottom horizontal Left reverse\n");
+    gnuplot->puts ("set key on inside left top vertical Left reverse\n");
+    gnuplot->puts ("set size ratio -1\n");
+    gnuplot->puts ("set auto fix\n");
+    gnuplot->puts ("set offsets graph 0.2, graph 0.05, graph 0.05, graph 0.05\n");
 
-    for (const auto& source : data_sources) {
+    for (auto& source : data_sources) {
         const auto t = timestep ? *timestep : source.source->current_timestep();
-        pose origin;
-        if (ground_truth && source.source != ground_truth) {
-            if (match_ground_truth && source.source->get_feature_map().size() >= 2) {
-                origin = planar_robot::estimate_initial_pose(ground_truth->get_feature_map(),
-                                                             source.source->get_feature_map());
-            }
-            else {
-                origin = ground_truth->get_initial_state() + (-source.source->get_initial_state());
-            }
-        }
+        update_trajectory_cache (source, t);
+        const pose origin = source_origin (source);
         plot_map (source, origin);
         plot_trajectory (source, t, origin);
         plot_state (source, t, origin);
     }
-    gnuplot.plot ();
+    gnuplot->plot ();
+    
+    if (output_dir) gnuplot->puts ("set output\n");
+}
+
+
+void slam_plotter::plot_raster (boost::optional<slam::timestep_type> timestep,
+                                const boost::filesystem::path& file) {
+    
+    using namespace boost::adaptors;
+    
+    // Colours are taken from the gnuplot styles, e.g. "lc rgbcolor 'blue' lw 2"
+    auto style_colour = [](const std::string& style) {
+        const std::string key = "rgbcolor '";
+        const auto start = style.find (key);
+        if (start == std::string::npos) return raster_image::black;
+        const auto end = style.find ('\'', start + key.size());
+        return raster_image::from_name (style.substr (start + key.size(), end - start - key.size()));
+    };
+    
+    raster_renderer::frame frame;
+    frame.filename = file.string();
+    
+    for (auto& source : data_sources) {
+        
+        const auto t = timestep ? *timestep : source.source->current_timestep();
+        update_trajectory_cache (source, t);
+        const pose origin = source_origin (source);
+        
+        raster_renderer::layer layer;
+        layer.autoscale = source.autoscale_map;
+        layer.landmark_colour = style_colour (source.feature_point_style);
+        layer.trajectory_colour = style_colour (source.trajectory_line_style);
+        layer.state_colour = style_colour (source.state_arrow_style);
+        
+        for (const auto& feature : values(source.source->get_feature_map())) {
+            position pos = origin + feature;
+            layer.landmarks.push_back (pos.x());
+            layer.landmarks.push_back (pos.y());
+        }
+        
+        for_each_trajectory_point (source, [&](const pose& p) {
+            pose state = origin + p;
+            layer.trajectory.push_back (state.x());
+            layer.trajectory.push_back (state.y());
+        });
+        
+        pose state = origin + source.trajectory_cache[t];
+        layer.state_x = state.x();
+        layer.state_y = state.y();
+        layer.state_bearing = state.bearing();
+        
+        frame.layers.push_back (std::move (layer));
+    }
     
-    if (output_dir) gnuplot.puts ("set output\n");
+    raster->submit (std::move (frame));
 }
 
 
 void slam_plotter::add_title (const std::string& title) {
-    if (!title.empty()) std::fprintf (gnuplot.handle(), "title '%s' ", title.c_str());
-    else gnuplot.puts ("notitle ");
+    if (!title.empty()) gnuplot->printf ("title '%s' ", title.c_str());
+    else gnuplot->puts ("notitle ");
 }
 
 
@@ -105,45 +184,83 @@ void slam_plotter::plot_map (const data_source& source, const pose& origin) {
     
     for (const auto& feature : values(feature_map)) {
         position pos = origin + feature;
-        gnuplot << pos.x() << pos.y();
+        *gnuplot << pos.x() << pos.y();
     }
 
-    gnuplot.plot (2);    
-    if (!source.autoscale_map) gnuplot.puts ("noautoscale ");
+    gnuplot->plot (2);    
+    if (!source.autoscale_map) gnuplot->puts ("noautoscale ");
     add_title (source.landmark_title);
-    gnuplot.puts ("with points ");
-    gnuplot.puts (source.feature_point_style.c_str());
+    gnuplot->puts ("with points ");
+    gnuplot->puts (source.feature_point_style.c_str());
+}
+
+
+void slam_plotter::update_trajectory_cache (data_source& source, slam::timestep_type t) {
+    
+    auto& cache = source.trajectory_cache;
+    const auto revision = source.source->trajectory_revision();
+    
+    if (revision == slam_result_type::unknown_revision || revision != source.cached_revision
+        || cache.size() > t+1) {
+        cache.clear();
+    }
+    source.cached_revision = revision;
+    
+    if (cache.size() == t+1) return;
+    
+    // Extend with the states that are not yet cached
+    const std::size_t begin = cache.size();
+    cache.resize (t+1);
+    source.source->export_states (slam::timestep_type(begin), t+1, &cache[begin]);
+}
+
+
+template <class Function>
+void slam_plotter::for_each_trajectory_point (const data_source& source, Function f) const {
+    
+    const auto& cache = source.trajectory_cache;
+    
+    // Decimate long trajectories so that the per-frame cost stays bounded
+    const std::size_t stride = max_trajectory_points > 0
+    ? (cache.size() + max_trajectory_points - 1) / max_trajectory_points : 1;
+    
+    for (std::size_t i = 0; i < cache.size(); i += std::max<std::size_t> (stride, 1)) f (cache[i]);
+    if (stride > 1 && (cache.size()-1) % stride != 0) f (cache.back());
 }
 
 
 void slam_plotter::plot_trajectory (const data_source& source, slam::timestep_type t,
                                     const pose& origin) {
     
-    for (slam::timestep_type i; i <= t; ++i) {
-        pose state = origin + source.source->get_state(i);
-        gnuplot << state.x() << state.y();
-    }
+    assert (source.trajectory_cache.size() == t+1);
+    (void)t; // Silence unused parameter warning in release builds
     
-    gnuplot.plot (2);
-    gnuplot.puts ("noautoscale notitle with lines ");
-    gnuplot.puts (source.trajectory_line_style.c_str());
+    for_each_trajectory_point (source, [&](const pose& p) {
+        pose state = origin + p;
+        *gnuplot << state.x() << state.y();
+    });
+    
+    gnuplot->plot (2);
+    gnuplot->puts ("noautoscale notitle with lines ");
+    gnuplot->puts (source.trajectory_line_style.c_str());
 }
 
 
 void slam_plotter::plot_state (const data_source& source, slam::timestep_type t,
                                const pose& origin) {
 
-    pose state = origin + source.source->get_state(t);
+    assert (source.trajectory_cache.size() == t+1);
+    pose state = origin + source.trajectory_cache[t];
     
     double epsilon = 1;
     double xdelta = epsilon * std::cos (state.bearing());
     double ydelta = epsilon * std::sin (state.bearing());
-    gnuplot << state.x() << state.y() << xdelta << ydelta;
+    *gnuplot << state.x() << state.y() << xdelta << ydelta;
     
-    gnuplot.plot (4);
-    gnuplot.puts ("noautoscale with vectors ");
+    gnuplot->plot (4);
+    gnuplot->puts ("noautoscale with vectors ");
     add_title (source.trajectory_title);
-    gnuplot.puts (source.state_arrow_style.c_str());
+    gnuplot->puts (source.state_arrow_style.c_str());
 }
 
 
@@ -156,6 +273,12 @@ boost::program_options::options_description slam_plotter::program_options () {
     ("slam-plot-output-dir", po::value<std::string>(),
      "Output directory for plots (displayed on screen if unset)")
     ("slam-plot-isometry", "calculate best fit between estimated map and ground truth")
+    ("slam-plot-max-points", po::value<std::size_t>()->default_value(2000),
+     "maximum trajectory points plotted per estimator (0 for no limit)")
+    ("slam-plot-raster", "render frames with the built-in rasteriser instead of gnuplot")
+    ("slam-plot-format", po::value<std::string>()->default_value("png"), "image format for rasterised frames (png or ppm)")
+    ("slam-plot-threads", po::value<unsigned int>()->default_value(0),
+     "threads for rendering rasterised frames (0 for one per core)")
     ("debug-slam-plot", "switch to debugging mode");
     return options;
 }
@@ -163,13 +286,22 @@ boost::program_options::options_description slam_plotter::program_options () {
 
 slam_plotter::slam_plotter (boost::program_options::variables_map& options)
 : title (options["slam-plot-title"].as<std::string>()),
-gnuplot(options.count("debug-slam-plot") != 0),
-match_ground_truth(options.count("slam-plot-isometry"))
+match_ground_truth(options.count("slam-plot-isometry")),
+max_trajectory_points(options["slam-plot-max-points"].as<std::size_t>())
 {
     if (options.count ("slam-plot-output-dir")) {
         output_dir = boost::filesystem::path (options["slam-plot-output-dir"].as<std::string>());
         boost::filesystem::create_directories (*output_dir);
-        gnuplot.puts ("set terminal pngcairo font 'Sans,8' size 640, 480\n");
     }
+    
+    if (options.count ("slam-plot-raster")) {
+        const auto format = options["slam-plot-format"].as<std::string>() == "ppm"
+        ? raster_renderer::ppm : raster_renderer::png;
+        raster.reset (new raster_renderer (640, 480, format, options["slam-plot-threads"].as<unsigned int>()));
+        return;
+    }
+    
+    gnuplot.reset (new gnuplot_process (options.count("debug-slam-plot") != 0,
+                                        output_dir ? gnuplot_process::lossless : gnuplot_process::latest_only));
+    if (output_dir) gnuplot->puts ("set terminal pngcairo font 'Sans,8' size 640, 480\n");
 }
-
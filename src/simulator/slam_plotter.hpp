@@ -21,6 +21,7 @@
 #include "planar_robot/position.hpp"
 #include "slam/interfaces.hpp"
 #include "simulator/gnuplot_process.hpp"
+#include "simulator/raster_renderer.hpp"
 
 
 class slam_plotter : public slam::timestep_listener {
@@ -38,6 +39,11 @@ class slam_plotter : public slam::timestep_listener {
         std::string feature_point_style;
         std::string trajectory_line_style;
         std::string state_arrow_style;
+        
+        /** Absolute states up to the last plotted timestep, valid while the source's
+         trajectory_revision equals cached_revision. */
+        std::vector<pose> trajectory_cache;
+        std::size_t cached_revision;
     };
 
     /** Data members */
@@ -45,13 +51,21 @@ class slam_plotter : public slam::timestep_listener {
     boost::optional<boost::filesystem::path> output_dir;
     
     std::string title;
-    gnuplot_process gnuplot;
+    std::unique_ptr<gnuplot_process> gnuplot;
+    std::unique_ptr<raster_renderer> raster;
     std::vector<data_source> data_sources;
     std::shared_ptr<slam_result_type> ground_truth;
     bool match_ground_truth = false;
     
+    /** Maximum number of trajectory points sent to gnuplot per data source per frame. */
+    std::size_t max_trajectory_points;
+    
     /** Implementation member functions. */
     void add_title (const std::string& title);
+    void update_trajectory_cache (data_source&, slam::timestep_type t);
+    pose source_origin (const data_source&) const;
+    template <class Function> void for_each_trajectory_point (const data_source&, Function) const;
+    void plot_raster (boost::optional<slam::timestep_type> timestep, const boost::filesystem::path& file);
     void plot_map (const data_source&, const pose& origin);
     void plot_trajectory (const data_source&, slam::timestep_type t, const pose& origin);
     void plot_state (const data_source&, slam::timestep_type t, const pose& origin);
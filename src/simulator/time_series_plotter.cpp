@@ -9,13 +9,16 @@
 #include <cstdio>
 
 #include "simulator/time_series_plotter.hpp"
+#include "utility/trace.hpp"
 
 
 void time_series_plotter::timestep (slam::timestep_type timestep) {
     
+    SLAM_TRACE_SCOPE ("time_series_plotter::timestep", "timestep", timestep);
+    
     long xmax = long(timestep);
     long xmin = xmax + 1 - long(history_capacity);
-    std::fprintf (gnuplot.handle(), "set xrange [%ld:%ld]\n", xmin, xmax);
+    gnuplot.printf ("set xrange [%ld:%ld]\n", xmin, xmax);
     
     bool use_y2 = false;
     
@@ -29,8 +32,8 @@ void time_series_plotter::timestep (slam::timestep_type timestep) {
         if (value > range.second) range.second = value;
         source.history.push_back (value);
     }
-    std::fprintf (gnuplot.handle(), "set yrange [%f:%f]\n", yrange.first, yrange.second);
-    std::fprintf (gnuplot.handle(), "set y2range [%f:%f]\n", y2range.first, y2range.second);
+    gnuplot.printf ("set yrange [%f:%f]\n", yrange.first, yrange.second);
+    gnuplot.printf ("set y2range [%f:%f]\n", y2range.first, y2range.second);
     
     if (use_y2) gnuplot.puts ("set y2tics border\n");
     
@@ -42,7 +45,7 @@ void time_series_plotter::timestep (slam::timestep_type timestep) {
         gnuplot.plot (2);
         gnuplot.puts (source.secondary_axis ? "axes x1y2 " : "axes x1y1 ");
 
-        if (!source.title.empty()) std::fprintf (gnuplot.handle(), "title '%s' ", source.title.c_str());
+        if (!source.title.empty()) gnuplot.printf ("title '%s' ", source.title.c_str());
         else gnuplot.puts ("notitle ");
         
         gnuplot.puts ("with lines ");
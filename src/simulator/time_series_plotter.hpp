@@ -41,7 +41,8 @@ public:
         : history(capacity), function(f), title(title), style(style), secondary_axis(secondary) { }
     };
     
-    time_series_plotter (std::size_t capacity) : history_capacity(capacity) { }
+    time_series_plotter (std::size_t capacity)
+    : gnuplot(false, gnuplot_process::latest_only), history_capacity(capacity) { }
     
     virtual void timestep (slam::timestep_type) override;
     
@@ -65,19 +65,22 @@ namespace slam {
         
         std::vector<avg_acc<State>> state_avgs;
         utility::flat_map<featureid_type, avg_acc<Feature>> feature_avgs;
+        std::vector<State> states;
         
         for (const auto& result : indirect(results)) {
             
             const auto& initial_state = result.get_initial_state();
-            const auto& trajectory = result.get_trajectory();
             const auto& map = result.get_feature_map();
             
-            if (state_avgs.size() < trajectory.size()) {
-                state_avgs.resize (trajectory.size());
+            const std::size_t size = result.current_timestep();
+            if (state_avgs.size() < size) {
+                state_avgs.resize (size);
             }
             
-            for (size_t t = 0; t < trajectory.size(); ++t) {
-                state_avgs[t].accumulate (trajectory.accumulate (t+1));
+            states.resize (size);
+            result.export_states (timestep_type(1), timestep_type(size+1), states.data());
+            for (size_t t = 0; t < size; ++t) {
+                state_avgs[t].accumulate (-initial_state + states[t]);
             }
             
             for (const auto& feature : map) {
@@ -28,6 +28,8 @@
 #include "utility/random.hpp"
 #include "utility/unscented.hpp"
 #include "utility/cowmap.hpp"
+#include "utility/log.hpp"
+#include "utility/memory.hpp"
 #include "utility/flat_map.hpp"
 #include "utility/bitree.hpp"
 #include "utility/utility.hpp"
@@ -162,6 +164,14 @@ namespace slam {
         
         virtual auto get_feature_map () const -> const feature_map_type& override;
         
+    protected:
+        
+        virtual void export_states_impl (timestep_type first, timestep_type last, state_type* out) const override;
+        
+        virtual void export_features_impl (feature_map_type&) const override;
+        
+    public:
+        
         // Overridden virtual member functions of slam::slam_data::listener
         
         virtual void control (timestep_type t, const ControlModel& control) override {
@@ -243,7 +253,7 @@ void slam::fastslam<ControlModel, ObservationModel>
     map_estimate.clear();
     ++next_timestep;
     
-    std::cout << "Effective particle set: " << particles.effective_size() << std::endl;
+    SLAM_LOG_INFO ("fastslam.effective_particle_set", {{"timestep", timestep}, {"size", particles.effective_size()}});
 }
 
 
@@ -282,7 +292,9 @@ auto slam::fastslam<ControlModel, ObservationModel>
     }
     
     if (!discard_history) {
-        particle.trajectory.previous = std::make_shared<typename particle_type::state_list> (particle.trajectory);
+        using state_list = typename particle_type::state_list;
+        using allocator = utility::tracked_allocator<state_list, utility::memory::fastslam>;
+        particle.trajectory.previous = std::allocate_shared<state_list> (allocator(), particle.trajectory);
     }
     
     particle.trajectory.state = state_proposal (random);
@@ -367,22 +379,47 @@ template <class ControlModel, class ObservationModel>
 auto slam::fastslam<ControlModel, ObservationModel>
 ::get_feature_map () const -> const feature_map_type& {
     
-    if (map_estimate.size() != num_features) {
-        
-        map_estimate.clear();
-        map_estimate.reserve(num_features);
-        
-        auto map_inserter = [&](featureid_type id, const feature_dist& estimate) {
-            map_estimate.emplace_hint (map_estimate.cend(), id, estimate.mean());
-        };
-        particles.max_weight_particle().features.for_each (map_inserter);
-    }
+    if (map_estimate.size() != num_features) export_features_impl (map_estimate);
     
     assert (map_estimate.size() == num_features);
     return map_estimate;
 }
 
 
+template <class ControlModel, class ObservationModel>
+void slam::fastslam<ControlModel, ObservationModel>
+::export_states_impl (timestep_type first, timestep_type last, state_type* out) const {
+    
+    if (!discard_history && trajectory_estimate.size() != current_timestep()) {
+        
+        // Walk back along the state list of the best particle, skipping states after the range
+        const typename particle_type::state_list* p = &particles.max_weight_particle().trajectory;
+        for (std::size_t t = current_timestep(); t >= last; --t) p = p->previous.get();
+        for (std::size_t t = last; t-- > first; p = p->previous.get()) {
+            assert (p);
+            out[t-first] = p->state;
+        }
+    }
+    else {
+        trajectory_estimate.accumulate_range (first, last, out);
+    }
+}
+
+
+template <class ControlModel, class ObservationModel>
+void slam::fastslam<ControlModel, ObservationModel>
+::export_features_impl (feature_map_type& out) const {
+    
+    out.clear();
+    out.reserve(num_features);
+    
+    auto map_inserter = [&](featureid_type id, const feature_dist& estimate) {
+        out.emplace_hint (out.cend(), id, estimate.mean());
+    };
+    particles.max_weight_particle().features.for_each (map_inserter);
+}
+
+
 template <class ControlModel, class ObservationModel>
 auto slam::fastslam<ControlModel, ObservationModel>
 ::program_options () -> boost::program_options::options_description {
@@ -20,6 +20,7 @@
 #include "slam/interfaces.hpp"
 #include "slam/fastslam.hpp"
 #include "slam/mcmc_slam.hpp"
+#include "utility/log.hpp"
 
 #include "main.hpp"
 
@@ -91,10 +92,9 @@ void slam::fastslam_mcmc<ControlModel, ObservationModel>
     if (resample_required && resample_required_previous) {
         m_fastslam->get_trajectory();
         m_mcmc_slam->timestep(t);
-        std::cout << "Reinitialising FastSLAM... ";
+        SLAM_LOG_INFO ("fastslam_mcmc.reinitialise", {{"timestep", t}, {"particles", m_fastslam->num_particles}});
         m_fastslam->particles.reinitialize (m_fastslam->num_particles,
                                             std::bind(&fastslam_mcmc::sample_particle, this));
-        std::cout <<"done\n";
         resample_required = false;
     }
 }
@@ -104,7 +104,7 @@ template <class ControlModel, class ObservationModel>
 void slam::fastslam_mcmc<ControlModel, ObservationModel>
 ::completed () {
     
-    std::cout << "Running MCMC steps at end.\n";
+    SLAM_LOG_INFO ("fastslam_mcmc.end_steps", {{"steps", mcmc_end_steps}});
     
     if (m_mcmc_slam) {
         for (unsigned int i = 0; i < mcmc_end_steps; ++i) m_mcmc_slam->update();
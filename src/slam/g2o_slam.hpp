@@ -12,6 +12,7 @@
 #include <memory>
 #include <iostream>
 #include <cassert>
+#include <limits>
 
 #include <boost/program_options.hpp>
 
@@ -30,12 +31,34 @@
 #include "slam/interfaces.hpp"
 #include "slam/slam_data.hpp"
 #include "utility/bitree.hpp"
+#include "utility/counters.hpp"
+#include "utility/memory.hpp"
+#include "utility/trace.hpp"
 #include "utility/random.hpp"
 #include "utility/utility.hpp"
 
 #include "main.hpp"
 
 
+#ifdef SLAM_MEMORY_TRACKING
+/** Eigen's aligned operator new, also counting the bytes against the g2o_slam memory tag. The
+ vertices and edges are deleted by g2o through base pointers with virtual destructors, so the
+ sized operator delete sees the size that was allocated. */
+#define G2O_SLAM_OPERATOR_NEW \
+    static void* operator new (std::size_t bytes) { \
+        void* p = Eigen::internal::aligned_malloc (bytes); \
+        utility::memory::allocated (utility::memory::g2o_slam, bytes); \
+        return p; \
+    } \
+    static void operator delete (void* p, std::size_t bytes) noexcept { \
+        utility::memory::deallocated (utility::memory::g2o_slam, bytes); \
+        Eigen::internal::aligned_free (p); \
+    }
+#else
+#define G2O_SLAM_OPERATOR_NEW EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+#endif
+
+
 namespace slam {    
     
     template <class ControlModel, class ObservationModel>
@@ -62,7 +85,7 @@ namespace slam {
         
         struct vertex_state : public g2o::BaseVertex<state_type::vector_dim, state_type> {
             
-            EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
+            G2O_SLAM_OPERATOR_NEW;
             
             vertex_state () = default;
             
@@ -89,7 +112,7 @@ namespace slam {
         
         struct vertex_landmark : public g2o::BaseVertex<feature_type::vector_dim, feature_type> {
             
-            EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
+            G2O_SLAM_OPERATOR_NEW;
             
             vertex_landmark () = default;
             
@@ -118,7 +141,7 @@ namespace slam {
         struct edge_control
         : public g2o::BaseBinaryEdge<ControlModel::vector_dim, control_type, vertex_state, vertex_state> {
             
-            EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
+            G2O_SLAM_OPERATOR_NEW;
 
             edge_control (vertex_state* v0, vertex_state* v1, const ControlModel& control) {
 
@@ -149,7 +172,7 @@ namespace slam {
         struct edge_obs
         : public g2o::BaseBinaryEdge<ObservationModel::vector_dim, observation_type, vertex_state, vertex_landmark> {
           
-            EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
+            G2O_SLAM_OPERATOR_NEW;
             
             edge_obs (vertex_state* v0, vertex_landmark* v1, const ObservationModel& obs) {
 
@@ -189,13 +212,22 @@ namespace slam {
         g2o::HyperGraph::EdgeSet new_edges;
         bool optimizer_need_init = true;
         
-        std::vector<vertex_state*> state_vertices;
-        std::map<featureid_type, vertex_landmark*> feature_vertices;
+        template <class T> using allocator = utility::tracked_allocator<T, utility::memory::g2o_slam>;
+        
+        std::vector<vertex_state*, allocator<vertex_state*>> state_vertices;
+        std::map<featureid_type, vertex_landmark*, std::less<featureid_type>,
+                 allocator<std::pair<const featureid_type, vertex_landmark*>>> feature_vertices;
         int next_vertex_id = 0;
         
         mutable trajectory_type trajectory_estimate;
         mutable feature_map_type map_estimate;
         
+        // Incremented whenever the optimiser moves existing vertices
+        std::size_t revision = 0;
+        
+        // Robust chi-squared error after the last optimisation
+        double chi2 = std::numeric_limits<double>::quiet_NaN();
+        
         timestep_type next_timestep;
         
     public:
@@ -208,6 +240,12 @@ namespace slam {
         
         int optimise (int iterations = 1000);
         
+        /** Log likelihood, up to a constant, as of the last optimisation. NaN if vertices or
+         edges have been added since, because it would not include them. */
+        auto get_log_likelihood () const -> double {
+            return new_vertices.empty() && new_edges.empty() ? -chi2/2 : std::numeric_limits<double>::quiet_NaN();
+        }
+        
         /** Overridden virtual member functions of slam::slam_data::listener */
 
         virtual void control (timestep_type t, const ControlModel& control) override;
@@ -234,8 +272,22 @@ namespace slam {
         
         virtual auto get_feature_map () const -> const feature_map_type& override;
         
+        virtual auto trajectory_revision () const -> std::size_t override {
+            return revision;
+        }
+        
         double objective_value () const { return optimizer.activeRobustChi2(); }
         
+    protected:
+        
+        virtual void export_states_impl (timestep_type first, timestep_type last, state_type* out) const override {
+            for (timestep_type t = first; t < last; ++t) *out++ = state_vertices[t]->estimate();
+        }
+        
+        virtual void export_features_impl (feature_map_type&) const override;
+        
+    public:
+        
         class updater : public timestep_listener {
             
             std::shared_ptr<g2o_slam> instance;
@@ -281,6 +333,7 @@ void slam::g2o_slam<ControlModel, ObservationModel>
         feature_vertices.at(feature.first)->setEstimate (-initial_state + feature.second);
     }
     map_estimate.clear();
+    ++revision;
 }
 
 
@@ -291,6 +344,8 @@ auto slam::g2o_slam<ControlModel, ObservationModel>
     if (max_iterations <= 0 || state_vertices.size() <= 1 || feature_vertices.empty()) {
         return 0;
     }
+
+    SLAM_TRACE_SCOPE ("g2o_slam::optimise", "max_iterations", max_iterations);
     
     if (optimizer_need_init) {
         optimizer.initializeOptimization();
@@ -305,9 +360,14 @@ auto slam::g2o_slam<ControlModel, ObservationModel>
     
     const int iterations = optimizer.optimize(max_iterations, false);
     optimizer_force_stop_flag = false;
+
+    SLAM_COUNT_N (g2o_iterations, iterations);
+    chi2 = optimizer.activeRobustChi2();
+    SLAM_GAUGE (g2o_chi2, chi2);
     
     trajectory_estimate.clear();
     map_estimate.clear();
+    ++revision;
     
     return iterations;
 }
@@ -399,21 +459,26 @@ template <class ControlModel, class ObservationModel>
 auto slam::g2o_slam<ControlModel, ObservationModel>
 ::get_feature_map () const -> const feature_map_type& {
     
-    if (map_estimate.size() != feature_vertices.size()) {
-        
-        map_estimate.clear();
-        map_estimate.reserve (feature_vertices.size());
-        
-        for (const auto& entry : feature_vertices) {
-            map_estimate.emplace_hint (map_estimate.end(), entry.first, entry.second->estimate());
-        }
-    }
+    if (map_estimate.size() != feature_vertices.size()) export_features_impl (map_estimate);
     
     assert (map_estimate.size() == feature_vertices.size());
     return map_estimate;
 }
 
 
+template <class ControlModel, class ObservationModel>
+void slam::g2o_slam<ControlModel, ObservationModel>
+::export_features_impl (feature_map_type& out) const {
+    
+    out.clear();
+    out.reserve (feature_vertices.size());
+    
+    for (const auto& entry : feature_vertices) {
+        out.emplace_hint (out.end(), entry.first, entry.second->estimate());
+    }
+}
+
+
 template <class ControlModel, class ObservationModel>
 slam::g2o_slam<ControlModel, ObservationModel>
 ::g2o_slam (const decltype(initialiser)& init) : initialiser(init)
@@ -9,6 +9,7 @@
 #ifndef slam_interfaces_hpp
 #define slam_interfaces_hpp
 
+#include <cassert>
 #include <cstddef>
 #include <cmath>
 #include <utility>
@@ -86,7 +87,30 @@ namespace slam {
         virtual auto get_trajectory () const -> const trajectory_type& = 0;
         virtual auto get_feature_map () const -> const feature_map_type& = 0;
         
+        /** Writes get_state(t) for each t in [first, last) to out. Implementations fill this in
+         a single pass over their own storage, instead of one virtual call per timestep. */
+        void export_states (timestep_type first, timestep_type last, state_type* out) const {
+            assert (first <= last && last <= current_timestep()+1);
+            if (first != last) export_states_impl (first, last, out);
+        }
+        
+        /** Replaces the contents of out with the absolute position of every feature. */
+        void export_features (feature_map_type& out) const {
+            export_features_impl (out);
+        }
+        
+        /** A counter that changes whenever the states of past timesteps may have changed.
+         Appending new timesteps leaves it unchanged, so consumers can cache the trajectory and
+         extend it incrementally. Results that do not track changes return unknown_revision. */
+        static constexpr std::size_t unknown_revision = std::size_t(-1);
+        virtual auto trajectory_revision () const -> std::size_t { return unknown_revision; }
+        
         virtual ~slam_result () = default;
+        
+    protected:
+        
+        virtual void export_states_impl (timestep_type first, timestep_type last, state_type* out) const = 0;
+        virtual void export_features_impl (feature_map_type& out) const = 0;
     };
     
     template <class ControlModel, class ObsModel>
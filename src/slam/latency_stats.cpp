@@ -0,0 +1,108 @@
+#include <iomanip>
+#include <iostream>
+#include <memory>
+
+#include <cxxabi.h>
+#include <cstdlib>
+
+#include "slam/latency_stats.hpp"
+
+
+namespace {
+
+    /** The demangled type name with template arguments removed, so that the report stays readable */
+    auto listener_name (const std::type_info& type) -> std::string {
+
+        int status = 0;
+        std::unique_ptr<char, void(*)(void*)> demangled (abi::__cxa_demangle (type.name(), nullptr, nullptr, &status),
+                                                         std::free);
+        const std::string full = (status == 0 && demangled) ? demangled.get() : type.name();
+
+        std::string name;
+        int depth = 0;
+        for (char c : full) {
+            if (c == '<') ++depth;
+            else if (c == '>') --depth;
+            else if (depth == 0) name.push_back (c);
+        }
+        return name;
+    }
+
+}
+
+
+slam::latency_stats::latency_stats (unsigned int interval) : interval (interval) {
+    for (unsigned int e = 0; e < num_events; ++e) dispatch[e].name = event_name (event (e));
+}
+
+
+slam::latency_stats::latency_stats (const boost::program_options::variables_map& options)
+: latency_stats (options["latency-interval"].as<unsigned int>())
+{ }
+
+
+auto slam::latency_stats::event_name (event e) -> const char* {
+    switch (e) {
+        case control: return "add_control";
+        case observation: return "add_observation";
+        case timestep: return "timestep";
+        default: return "unknown";
+    }
+}
+
+
+void slam::latency_stats::record (event e, const std::type_info& listener, std::uint64_t nanoseconds) {
+    auto iter = listeners.find (std::make_pair (e, std::type_index (listener)));
+    if (iter == listeners.end()) {
+        iter = listeners.emplace (std::make_pair (e, std::type_index (listener)), entry()).first;
+        iter->second.name = listener_name (listener);
+    }
+    iter->second.histogram.record (nanoseconds);
+}
+
+
+void slam::latency_stats::timestep_completed (timestep_type t) {
+    if (interval > 0 && t > 0 && std::size_t(t) % interval == 0) {
+        std::cerr << "Latency after timestep " << std::size_t(t) << ":\n";
+        report (std::cerr);
+    }
+}
+
+
+void slam::latency_stats::report (std::ostream& out, const entry& e, bool indent) const {
+    const auto& h = e.histogram;
+    const auto us = [](std::uint64_t ns) { return ns * 1e-3; };
+    out << (indent ? "  " : "") << std::left << std::setw (indent ? 38 : 40) << e.name << std::right
+    << std::setw (10) << h.count()
+    << std::fixed << std::setprecision (1)
+    << std::setw (12) << us (h.percentile (0.5))
+    << std::setw (12) << us (h.percentile (0.99))
+    << std::setw (12) << us (h.percentile (0.999))
+    << std::setw (12) << us (h.max()) << '\n';
+    out.unsetf (std::ios::floatfield);
+    out << std::setprecision (6);
+}
+
+
+void slam::latency_stats::report (std::ostream& out) const {
+    out << std::left << std::setw (40) << "Latency (microseconds)" << std::right
+    << std::setw (10) << "count" << std::setw (12) << "p50" << std::setw (12) << "p99"
+    << std::setw (12) << "p99.9" << std::setw (12) << "max" << '\n';
+    for (unsigned int e = 0; e < num_events; ++e) {
+        report (out, dispatch[e], false);
+        for (const auto& l : listeners) {
+            if (l.first.first == event (e)) report (out, l.second, true);
+        }
+    }
+    out << std::endl;
+}
+
+
+auto slam::latency_stats::program_options () -> boost::program_options::options_description {
+    namespace po = boost::program_options;
+    po::options_description options ("Latency Histogram Options");
+    options.add_options()
+    ("latency-interval", po::value<unsigned int>()->default_value(0),
+     "timesteps between latency reports during the run (0 to report only at the end)");
+    return options;
+}
@@ -0,0 +1,77 @@
+#ifndef _SLAM_LATENCY_STATS_HPP
+#define _SLAM_LATENCY_STATS_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <iosfwd>
+#include <map>
+#include <string>
+#include <typeindex>
+#include <typeinfo>
+#include <utility>
+
+#include <boost/program_options.hpp>
+
+#include "slam/interfaces.hpp"
+#include "utility/latency_histogram.hpp"
+
+
+namespace slam {
+
+
+    /** Latency histograms for the events that slam_data dispatches to its listeners, both for each
+     dispatch as a whole and for each type of listener. Reported as p50/p99/p99.9/max at the end of
+     a run and, if an interval is set, every interval timesteps. */
+    class latency_stats {
+
+    public:
+
+        enum event : unsigned int { control, observation, timestep, num_events };
+
+        using clock = std::chrono::steady_clock;
+
+    private:
+
+        struct entry {
+            std::string name;
+            utility::latency_histogram histogram;
+        };
+
+        entry dispatch[num_events];
+        std::map<std::pair<event, std::type_index>, entry> listeners;
+
+        unsigned int interval;
+
+        static const char* event_name (event);
+
+        void report (std::ostream&, const entry&, bool indent) const;
+
+    public:
+
+        explicit latency_stats (unsigned int interval = 0);
+        explicit latency_stats (const boost::program_options::variables_map&);
+
+        static std::uint64_t nanoseconds_since (clock::time_point start) {
+            return std::chrono::duration_cast<std::chrono::nanoseconds> (clock::now() - start).count();
+        }
+
+        /** Latency of one dispatch to all listeners */
+        void record (event e, std::uint64_t nanoseconds) {
+            dispatch[e].histogram.record (nanoseconds);
+        }
+
+        /** Latency of one listener, identified by its dynamic type */
+        void record (event, const std::type_info& listener, std::uint64_t nanoseconds);
+
+        /** Writes a report if the interval has elapsed */
+        void timestep_completed (timestep_type);
+
+        void report (std::ostream&) const;
+
+        static boost::program_options::options_description program_options ();
+    };
+
+
+}
+
+#endif
@@ -0,0 +1,4 @@
+#include "slam/mcmc_sample_archive.hpp"
+
+template class slam::mcmc_sample_writer<control_model_type, observation_model_type>;
+template class slam::mcmc_sample_reader<control_model_type, observation_model_type>;
@@ -0,0 +1,404 @@
+#ifndef _SLAM_MCMC_SAMPLE_ARCHIVE_HPP
+#define _SLAM_MCMC_SAMPLE_ARCHIVE_HPP
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cassert>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <stdexcept>
+
+#include "slam/interfaces.hpp"
+#include "slam/mcmc_slam.hpp"
+#include "slam/slam_result_impl.hpp"
+#include "utility/bitree.hpp"
+#include "utility/flat_map.hpp"
+#include "utility/utility.hpp"
+
+#include "main.hpp"
+
+
+namespace slam {
+
+
+    namespace mcmc_sample_archive_details {
+
+        /** File layout: a header, followed by one record per sample, followed by the index and a
+         trailer. A record is either a key record, holding every state and feature edge, or a delta
+         record, holding only the edges that changed since the previous sample. The index stores
+         the offset of each record and of the key record it depends on, and the trailer stores the
+         offset of the index so that readers can seek straight to it. */
+
+        const char magic[8] = { 'M', 'C', 'M', 'C', 'S', 'M', 'P', 'L' };
+        const std::uint32_t version = 1;
+
+        enum record_type : std::uint8_t { key_record = 0, delta_record = 1 };
+
+        struct index_entry {
+            std::uint64_t offset;
+            std::uint64_t key_offset;
+        };
+
+    }
+
+
+    /** Writes thinned mcmc_slam samples to a compact binary archive. Edges are stored in their
+     native mcmc_slam form (relative poses and parent-relative features), so a thinned sample
+     usually differs from its predecessor in only a handful of edges. Every key_interval samples a
+     full key record is written to bound the cost of random access. */
+
+    template <class ControlModel, class ObservationModel>
+    class mcmc_sample_writer {
+
+        using mcmc_slam_type = mcmc_slam<ControlModel, ObservationModel>;
+
+        using state_type = typename ControlModel::associated_type;
+        using feature_type = typename ObservationModel::associated_type;
+
+        using state_vector = typename state_type::vector_type;
+        using feature_vector = typename feature_type::vector_type;
+
+        struct feature_record {
+            std::uint64_t id;
+            std::uint64_t parent;
+            feature_vector estimate;
+        };
+
+        std::shared_ptr<FILE> file;
+        std::vector<char> file_buffer;
+        std::uint64_t offset = 0;
+
+        std::vector<mcmc_sample_archive_details::index_entry> index;
+        const unsigned int key_interval;
+
+        // Edges of the previously written sample, used to compute deltas
+        std::vector<state_vector> last_states;
+        std::vector<feature_record> last_features;
+
+        // Scratch space reused between samples
+        std::vector<std::uint64_t> changed;
+
+        template <class T> void write_raw (const T* data, std::size_t count);
+        template <class T> void write_value (const T& value) { write_raw (&value, 1); }
+
+        void write_state (const state_vector& v) { write_raw (v.data(), state_type::vector_dim); }
+        void write_feature (const feature_record&);
+
+    public:
+
+        mcmc_sample_writer (const std::string& filename, unsigned int key_interval = 64);
+        ~mcmc_sample_writer ();
+
+        mcmc_sample_writer (const mcmc_sample_writer&) = delete;
+        mcmc_sample_writer& operator= (const mcmc_sample_writer&) = delete;
+
+        auto num_samples () const -> std::size_t { return index.size(); }
+
+        /** Appends a sample. Does nothing once the archive is closed, including after a failed
+         write, which closes it and throws std::runtime_error. */
+        void write (const mcmc_slam_type&);
+
+        /** Writes the index and trailer. Called automatically on destruction, where a failure is
+         reported on standard error instead of thrown. After a failed write the archive is closed
+         and incomplete, and std::runtime_error is thrown. */
+        void close ();
+    };
+
+
+    /** Reads samples back from an archive written by mcmc_sample_writer. Sample k is
+     reconstructed by applying the deltas since its nearest preceding key record. */
+
+    template <class ControlModel, class ObservationModel>
+    class mcmc_sample_reader {
+
+        using state_type = typename ControlModel::associated_type;
+        using feature_type = typename ObservationModel::associated_type;
+
+        using state_vector = typename state_type::vector_type;
+        using feature_vector = typename feature_type::vector_type;
+
+        using slam_result_impl_type = slam_result_impl<state_type, feature_type>;
+
+        struct feature_record {
+            std::uint64_t id;
+            std::uint64_t parent;
+            feature_vector estimate;
+        };
+
+        std::shared_ptr<FILE> file;
+        std::vector<mcmc_sample_archive_details::index_entry> index;
+
+        template <class T> void read_raw (T* data, std::size_t count);
+        template <class T> T read_value () { T value; read_raw (&value, 1); return value; }
+
+        void seek (std::uint64_t offset);
+
+        /** Applies the record at the current file position. Returns its log likelihood. */
+        double read_record (std::vector<state_vector>&, std::vector<feature_record>&);
+
+    public:
+
+        explicit mcmc_sample_reader (const std::string& filename);
+
+        auto num_samples () const -> std::size_t { return index.size(); }
+
+        auto read (std::size_t k) -> slam_result_impl_type { double ll; return read (k, ll); }
+        auto read (std::size_t k, double& log_likelihood) -> slam_result_impl_type;
+    };
+
+
+} // namespace slam
+
+
+template <class ControlModel, class ObservationModel>
+slam::mcmc_sample_writer<ControlModel, ObservationModel>
+::mcmc_sample_writer (const std::string& filename, unsigned int key_interval)
+: file(utility::open_file (filename.c_str(), "wb")), key_interval(std::max (key_interval, 1u))
+{
+    if (!file) throw std::runtime_error ("Could not open sample archive: " + filename);
+
+    // Full buffering with a large buffer keeps the sampler from blocking on small writes.
+    file_buffer.resize (1 << 20);
+    std::setvbuf (file.get(), file_buffer.data(), _IOFBF, file_buffer.size());
+
+    using namespace mcmc_sample_archive_details;
+    write_raw (magic, sizeof(magic));
+    write_value (version);
+    write_value (std::uint32_t (state_type::vector_dim));
+    write_value (std::uint32_t (feature_type::vector_dim));
+}
+
+
+template <class ControlModel, class ObservationModel>
+template <class T>
+void slam::mcmc_sample_writer<ControlModel, ObservationModel>
+::write_raw (const T* data, std::size_t count) {
+    assert (file);
+    if (std::fwrite (data, sizeof(T), count, file.get()) != count) {
+        file.reset();
+        throw std::runtime_error ("Could not write sample archive");
+    }
+    offset += sizeof(T) * count;
+}
+
+
+template <class ControlModel, class ObservationModel>
+void slam::mcmc_sample_writer<ControlModel, ObservationModel>
+::write_feature (const feature_record& f) {
+    write_value (f.id);
+    write_value (f.parent);
+    write_raw (f.estimate.data(), feature_type::vector_dim);
+}
+
+
+template <class ControlModel, class ObservationModel>
+void slam::mcmc_sample_writer<ControlModel, ObservationModel>
+::write (const mcmc_slam_type& mcmc) {
+
+    using namespace mcmc_sample_archive_details;
+    if (!file) return;
+
+    const bool key = index.size() % key_interval == 0;
+    index.push_back ({ offset, key ? offset : index.back().key_offset });
+
+    write_value (key ? key_record : delta_record);
+    write_value (mcmc.get_log_likelihood());
+
+    // State edges
+
+    const auto& states = mcmc.state_estimates;
+    if (last_states.size() > states.size()) last_states.clear();
+
+    changed.clear();
+    for (std::size_t t = 0; t < states.size(); ++t) {
+        const state_vector v = state_type(states[t]).to_vector();
+        if (t >= last_states.size()) last_states.push_back (v);
+        else if (key || v != last_states[t]) last_states[t] = v;
+        else continue;
+        changed.push_back (t);
+    }
+
+    write_value (std::uint64_t (states.size()));
+    write_value (std::uint64_t (changed.size()));
+    for (auto t : changed) {
+        write_value (t);
+        write_state (last_states[t]);
+    }
+
+    // Feature edges
+
+    const auto& features = mcmc.feature_estimates;
+    if (last_features.size() > features.size()) last_features.clear();
+
+    changed.clear();
+    for (std::size_t i = 0; i < features.size(); ++i) {
+        const feature_record f {
+            std::size_t (features[i].id()), std::size_t (features[i].parent_timestep),
+            features[i].estimate.to_vector()
+        };
+        if (i >= last_features.size()) last_features.push_back (f);
+        else if (key || f.parent != last_features[i].parent || f.estimate != last_features[i].estimate) {
+            last_features[i] = f;
+        }
+        else continue;
+        changed.push_back (i);
+    }
+
+    write_value (std::uint64_t (features.size()));
+    write_value (std::uint64_t (changed.size()));
+    for (auto i : changed) {
+        write_value (i);
+        write_feature (last_features[i]);
+    }
+}
+
+
+template <class ControlModel, class ObservationModel>
+void slam::mcmc_sample_writer<ControlModel, ObservationModel>
+::close () {
+
+    using namespace mcmc_sample_archive_details;
+    if (!file) return;
+
+    const std::uint64_t index_offset = offset;
+    write_value (std::uint64_t (index.size()));
+    write_raw (index.data(), index.size());
+    write_value (index_offset);
+    write_raw (magic, sizeof(magic));
+
+    const bool flushed = std::fflush (file.get()) == 0;
+    file.reset();
+    if (!flushed) throw std::runtime_error ("Could not write sample archive");
+}
+
+
+template <class ControlModel, class ObservationModel>
+slam::mcmc_sample_writer<ControlModel, ObservationModel>
+::~mcmc_sample_writer () {
+    try { close(); }
+    catch (const std::exception& e) { std::cerr << e.what() << '\n'; }
+}
+
+
+template <class ControlModel, class ObservationModel>
+slam::mcmc_sample_reader<ControlModel, ObservationModel>
+::mcmc_sample_reader (const std::string& filename)
+: file(utility::open_file (filename.c_str(), "rb"))
+{
+    using namespace mcmc_sample_archive_details;
+
+    if (!file) throw std::runtime_error ("Could not open sample archive: " + filename);
+
+    char header_magic[sizeof(magic)];
+    read_raw (header_magic, sizeof(header_magic));
+    const auto header_version = read_value<std::uint32_t>();
+    const auto state_dim = read_value<std::uint32_t>();
+    const auto feature_dim = read_value<std::uint32_t>();
+
+    if (std::memcmp (header_magic, magic, sizeof(magic)) != 0 || header_version != version
+        || state_dim != state_type::vector_dim || feature_dim != feature_type::vector_dim) {
+        throw std::runtime_error ("Incompatible sample archive: " + filename);
+    }
+
+    const long trailer_size = sizeof(std::uint64_t) + sizeof(magic);
+    if (std::fseek (file.get(), -trailer_size, SEEK_END) != 0) {
+        throw std::runtime_error ("Truncated sample archive: " + filename);
+    }
+
+    const auto index_offset = read_value<std::uint64_t>();
+    char trailer_magic[sizeof(magic)];
+    read_raw (trailer_magic, sizeof(trailer_magic));
+    if (std::memcmp (trailer_magic, magic, sizeof(magic)) != 0) {
+        throw std::runtime_error ("Sample archive was not closed: " + filename);
+    }
+
+    seek (index_offset);
+    index.resize (read_value<std::uint64_t>());
+    read_raw (index.data(), index.size());
+}
+
+
+template <class ControlModel, class ObservationModel>
+template <class T>
+void slam::mcmc_sample_reader<ControlModel, ObservationModel>
+::read_raw (T* data, std::size_t count) {
+    if (std::fread (data, sizeof(T), count, file.get()) != count) {
+        throw std::runtime_error ("Unexpected end of sample archive");
+    }
+}
+
+
+template <class ControlModel, class ObservationModel>
+void slam::mcmc_sample_reader<ControlModel, ObservationModel>
+::seek (std::uint64_t offset) {
+    if (std::fseek (file.get(), long(offset), SEEK_SET) != 0) {
+        throw std::runtime_error ("Invalid offset in sample archive");
+    }
+}
+
+
+template <class ControlModel, class ObservationModel>
+auto slam::mcmc_sample_reader<ControlModel, ObservationModel>
+::read_record (std::vector<state_vector>& states, std::vector<feature_record>& features) -> double {
+
+    read_value<std::uint8_t>(); // Key and delta records are applied identically
+    const double log_likelihood = read_value<double>();
+
+    states.resize (read_value<std::uint64_t>());
+    for (auto n = read_value<std::uint64_t>(); n > 0; --n) {
+        const auto t = read_value<std::uint64_t>();
+        read_raw (states.at(t).data(), state_type::vector_dim);
+    }
+
+    features.resize (read_value<std::uint64_t>());
+    for (auto n = read_value<std::uint64_t>(); n > 0; --n) {
+        feature_record& f = features.at (read_value<std::uint64_t>());
+        f.id = read_value<std::uint64_t>();
+        f.parent = read_value<std::uint64_t>();
+        read_raw (f.estimate.data(), feature_type::vector_dim);
+    }
+
+    return log_likelihood;
+}
+
+
+template <class ControlModel, class ObservationModel>
+auto slam::mcmc_sample_reader<ControlModel, ObservationModel>
+::read (std::size_t k, double& log_likelihood) -> slam_result_impl_type {
+
+    const auto& entry = index.at(k);
+
+    std::vector<state_vector> states;
+    std::vector<feature_record> features;
+
+    seek (entry.key_offset);
+    std::size_t i = k;
+    while (i > 0 && index[i-1].key_offset == entry.key_offset) --i;
+
+    // Records are stored contiguously, so after the key record the deltas follow in order.
+    for (; i <= k; ++i) log_likelihood = read_record (states, features);
+
+    slam_result_impl_type result;
+
+    auto& trajectory = result.get_trajectory();
+    trajectory.reserve (states.size());
+    for (const auto& v : states) trajectory.push_back (state_type::from_vector (v));
+
+    auto& map = result.get_feature_map();
+    map.reserve (features.size());
+    for (const auto& f : features) {
+        const feature_type estimate = trajectory.accumulate (f.parent) + feature_type::from_vector (f.estimate);
+        map.emplace (featureid_type (f.id), estimate);
+    }
+
+    return result;
+}
+
+
+extern template class slam::mcmc_sample_writer<control_model_type, observation_model_type>;
+extern template class slam::mcmc_sample_reader<control_model_type, observation_model_type>;
+
+#endif //_SLAM_MCMC_SAMPLE_ARCHIVE_HPP
@@ -2,23 +2,39 @@
 #define _SLAM_MCMC_SLAM_HPP
 
 #include <map>
+#include <limits>
 #include <cassert>
 #include <cmath>
+#include <ctime>
 #include <utility>
 #include <algorithm>
 #include <memory>
 #include <vector>
+#include <string>
+#include <functional>
 #include <iostream>
 
+#include <Eigen/Cholesky>
+
+#include <boost/math/distributions/students_t.hpp>
 #include <boost/program_options.hpp>
 #include <boost/range/sub_range.hpp>
 #include <boost/range/adaptor/map.hpp>
 
 #include "slam/interfaces.hpp"
 #include "slam/slam_data.hpp"
+#include "slam/slam_result_impl.hpp"
+#include "slam/vector_transforms.hpp"
 #include "utility/random.hpp"
 #include "utility/bitree.hpp"
+#include "utility/counters.hpp"
+#include "utility/trace.hpp"
 #include "utility/flat_map.hpp"
+#include "utility/log.hpp"
+#include "utility/memory.hpp"
+#include "utility/rcu_cell.hpp"
+#include "utility/thread_pool.hpp"
+#include "utility/unscented.hpp"
 #include "utility/utility.hpp"
 
 #include "main.hpp"
@@ -28,6 +44,7 @@ namespace slam {
 
 
     template <class ControlModel, class ObservationModel> class fastslam_mcmc;
+    template <class ControlModel, class ObservationModel> class mcmc_sample_writer;
 
 
     /** This class implements the MCMC SLAM algorithm. To use it, construct an instance passing in
@@ -39,6 +56,7 @@ namespace slam {
     class mcmc_slam : public slam_result_of<ControlModel, ObservationModel> {
 
         friend class fastslam_mcmc<ControlModel, ObservationModel>;
+        friend class mcmc_sample_writer<ControlModel, ObservationModel>;
 
         using slam_result_type = slam_result_of<ControlModel, ObservationModel>;
         using slam_data_type = slam_data<ControlModel, ObservationModel>;
@@ -59,6 +77,9 @@ namespace slam {
 
         using feature_obs_range = boost::sub_range<const feature_observations>;
 
+        template <class T> using allocator = utility::tracked_allocator<T, utility::memory::mcmc_slam>;
+        using weight_tree = utility::bitree<double, allocator<double>>;
+
         /** For each observed feature, store a pointer to the feature's observations, the time
          step relative to which the feature estimate is stored, and the estimate itself. */
 
@@ -86,7 +107,7 @@ namespace slam {
 
             const ControlModel& distribution;
             typename utility::bitree<state_type>::reference estimate;
-            typename utility::bitree<double>::reference weight;
+            typename weight_tree::reference weight;
 
             state_edge (mcmc_slam& mcmc, timestep_type t)
             : timestep   (t),
@@ -102,7 +123,7 @@ namespace slam {
 
             const ObservationModel& distribution;
             feature_type& estimate;
-            typename utility::bitree<double>::reference weight;
+            typename weight_tree::reference weight;
 
             feature_edge (mcmc_slam& mcmc, std::size_t i)
             : feature    (mcmc.feature_estimates[i]),
@@ -121,13 +142,14 @@ namespace slam {
         random_source random;
 
         trajectory_type state_estimates;
-        utility::bitree<double> state_weights;
+        weight_tree state_weights;
 
-        std::vector<feature_estimate> feature_estimates;
-        utility::bitree<double> feature_weights;
+        std::vector<feature_estimate, allocator<feature_estimate>> feature_estimates;
+        weight_tree feature_weights;
 
         // Map feature id to index in feature_estimates
-        std::map<featureid_type, std::size_t> feature_index;
+        std::map<featureid_type, std::size_t, std::less<featureid_type>,
+                 allocator<std::pair<const featureid_type, std::size_t>>> feature_index;
 
         // Cache of map estimate in the form required by get_feature_map()
         mutable feature_map_type map_estimate;
@@ -138,25 +160,224 @@ namespace slam {
         // Log likelihood of the current trajectory and map estimate
         double log_likelihood = 0;
 
+        // Incremented whenever an existing state edge changes
+        std::size_t revision = 0;
+
+        // If greater than one, proposals are first screened with every surrogate_stride-th term
+        unsigned int surrogate_stride = 1;
+
+        // If positive, feature edges with more than austerity_batch observations are tested on
+        // growing random subsets, stopping when the error probability is below austerity_epsilon
+        double austerity_epsilon = 0;
+        unsigned int austerity_batch = 0;
+        std::vector<std::size_t> sample_order, sample_swaps;
+
+        // Probability of proposing a state edge from an unscented filter conditioned on the
+        // observations at its end, rather than from the control model alone
+        double ukf_weight = 0;
+        unscented_params<ControlModel::vector_dim> ukf_params {0.002, 2, 0};
+
+        /** Gaussian steps of an adaptive random walk in the coordinates of a proposal distribution.
+         The step covariance is 2.38^2/N times the mean outer product of the moves added so far,
+         plus a small ridge, and is recomputed every 10*N moves [Haario et al. 2001]. */
+        template <class Proposal>
+        class random_walk {
+
+            static constexpr int N = Proposal::vector_dim;
+            using result_type = typename Proposal::result_type;
+            using vector_type = typename Proposal::vector_type;
+            using matrix_type = Eigen::Matrix<double, N, N>;
+
+            multivariate_normal_dist<N> step;
+            matrix_type scatter = matrix_type::Zero();
+            std::size_t moves = 0;
+            bool ready = false;
+
+        public:
+
+            random_walk () { step.mean().setZero(); }
+
+            /** Whether enough moves have been added to define the steps */
+            explicit operator bool () const { return ready; }
+
+            /** A step from x. Steps that leave the domain of the coordinates, such as to a negative
+             range, do not survive the round trip through from_vector, and in_domain is set false:
+             the target has no density there, so such a proposal must be rejected. */
+            auto operator() (const result_type& x, random_source& random, bool& in_domain) const -> result_type {
+                const vector_type v = Proposal::to_vector (x) + step (random);
+                const result_type result = Proposal::from_vector (v);
+                // Loose enough for rounding, while leaving the domain moves a coordinate by O(1)
+                in_domain = Proposal::subtract (Proposal::to_vector (result), v).norm() <= 1e-6 * (1 + v.norm());
+                return result;
+            }
+
+            /** Log density of a step from a to b, which is also that of a step from b to a */
+            double log_likelihood (const result_type& a, const result_type& b) const {
+                return step.log_likelihood (Proposal::subtract (Proposal::to_vector (b), Proposal::to_vector (a)));
+            }
+
+            void add_move (const result_type& from, const result_type& to) {
+                const vector_type move = Proposal::subtract (Proposal::to_vector (to), Proposal::to_vector (from));
+                scatter += move * move.transpose();
+                if (++moves % (10*N) == 0) {
+                    const matrix_type cov = (2.38*2.38/N) * (scatter/moves + 1e-6 * matrix_type::Identity());
+                    step.chol_cov() = cov.llt().matrixL();
+                    ready = true;
+                }
+            }
+        };
+
+        // Probability of proposing an edge by a random walk from its current value rather than
+        // from its proposal distribution, once the walk for its kind of edge is ready. The walks
+        // adapt to the moves accepted in the first walk_burn_in updates, and are fixed afterwards.
+        double walk_weight = 0;
+        std::size_t walk_burn_in = 0, walk_updates = 0;
+        random_walk<typename ControlModel::proposal_dist> state_walk;
+        random_walk<typename ObservationModel::proposal_dist> feature_walk;
+        bool walk_proposed = false, walk_in_domain = true;
+
+        // If positive, the parents of features are moved to the median of their observations
+        // every reroot_interval time steps, instead of to their most accurate observation
+        unsigned int reroot_interval = 0;
+
+    public:
+
+        /** An immutable copy of the estimate, which may be read on any thread */
+        struct snapshot {
+            std::size_t sequence;
+            timestep_type timestep;
+            double log_likelihood;
+            slam_result_impl<state_type, feature_type> estimate;
+        };
+
+        using snapshot_cell = utility::rcu_cell<snapshot>;
+
+        /** Orders in which update() visits edges. The random scan chooses edges by edge weight.
+         The others scan every edge once per pass, in an order that does not depend on the
+         estimates, and so use plain Metropolis-Hastings updates: sweep visits edges in time order,
+         each feature beside the state edges at its parent; random_sweep does the same from a
+         random starting point on each pass; blocked visits all the features, then all the states. */
+        enum schedule_type : unsigned int { random_scan, sweep, random_sweep, blocked };
+
+        static auto parse_schedule (const std::string&) -> schedule_type;
+
+    private:
+
+        const std::shared_ptr<snapshot_cell> snapshots = std::make_shared<snapshot_cell>();
+        std::size_t num_snapshots = 0;
+
+        // The remaining edges of the current pass of a scheduled scan, as time steps of state
+        // edges below scan_states and indices of feature edges offset by scan_states
+        schedule_type schedule = random_scan;
+        std::vector<std::size_t> scan_order;
+        std::size_t scan_position = 0, scan_states = 0;
+
+        /** Updates the next edge of the scan, starting a new pass if the last one is finished */
+        bool update_scheduled ();
+        void start_scan ();
+
 
         /** Private member functions */
 
         void add_state_edge ();
         void add_feature_edge (const typename slam_data_type::observation_info&);
 
+        /** Moves each feature's parent to the median time step of its observations. A state edge
+         update evaluates the observations on the far side of the edge from the parent, so over
+         the span of a feature this costs the sum of the distances of its observations from the
+         parent, which the median minimises. The likelihood is unchanged. */
+        void reroot_features ();
+
         template <class EdgeType> bool update (EdgeType&&, bool use_edge_weight);
 
-        double edge_log_likelihood_ratio (const state_edge&, const state_type&) const;
-        double edge_log_likelihood_ratio (const feature_edge&, const feature_type&) const;
+        void edge_changed (const state_edge&) { ++revision; }
+        void edge_changed (const feature_edge&) { }
+
+        static void count_update (const state_edge&, bool accepted) {
+            SLAM_COUNT (state_proposals);
+            if (accepted) SLAM_COUNT (state_accepts);
+        }
+        static void count_update (const feature_edge&, bool accepted) {
+            SLAM_COUNT (feature_proposals);
+            if (accepted) SLAM_COUNT (feature_accepts);
+        }
+
+        using control_dist = multivariate_normal_dist<ControlModel::vector_dim>;
+
+        /** Draws a proposal for the edge, and sets proposal_log_ratio to the log of the density of
+         proposing it from the current estimate over that of proposing the current estimate from it. */
+        auto propose (const state_edge&, double& proposal_log_ratio) -> state_type;
+        auto propose (const feature_edge&, double& proposal_log_ratio) -> feature_type;
+
+        /** Conditions the control distribution of edge t on the observations at time step t+1 of
+         features whose estimates do not depend on edge t. Returns false if there are none. */
+        bool ukf_proposal (timestep_type t, control_dist&) const;
+
+        auto walk (const state_edge&) -> decltype (state_walk)& { return state_walk; }
+        auto walk (const feature_edge&) -> decltype (feature_walk)& { return feature_walk; }
+
+        /** The proposal_log_ratio of a mixture that takes a random walk step, whose log density is
+         step_log_likelihood, with probability walk_weight, and otherwise draws from a distribution
+         with the given log densities at the proposed and current values */
+        double walk_mixture_log_ratio (double step_log_likelihood, double new_log_likelihood,
+                                       double old_log_likelihood) const {
+            const double step = std::log (walk_weight) + step_log_likelihood;
+            return log_sum_exp (step, std::log1p (-walk_weight) + new_log_likelihood)
+            - log_sum_exp (step, std::log1p (-walk_weight) + old_log_likelihood);
+        }
+
+        static double log_sum_exp (double a, double b) {
+            const double m = std::max (a, b);
+            return m + std::log (std::exp (a - m) + std::exp (b - m));
+        }
+
+        /** Whether the log likelihood ratio of the proposal exceeds threshold. If so, log_ratio
+         is set to the exact ratio. */
+        bool likelihood_test (const state_edge&, const state_type&, double threshold, double& log_ratio);
+        bool likelihood_test (const feature_edge&, const feature_type&, double threshold, double& log_ratio);
+
+        /** An approximate likelihood_test for feature edges, which compares the mean log likelihood
+         ratio of a random sample of observations with threshold/N. Further batches are drawn until
+         a t-test rejects, at level austerity_epsilon, the hypothesis that the sample decision
+         differs from that of the full mean, or until every observation has been used. Proposals
+         that pass are then checked with the exact ratio, so rejects cost time sublinear in N but
+         passes still cost O(N), and the saving shrinks as the acceptance rate grows. */
+        bool sequential_test (const feature_edge&, const feature_type&, double threshold);
+
+        /** With a stride above one, only every stride-th feature or observation from offset is
+         included, scaled by the stride, which gives a cheap surrogate for the exact ratio. */
+        double edge_log_likelihood_ratio (const state_edge&, const state_type&,
+                                          std::size_t stride = 1, std::size_t offset = 0) const;
+        double edge_log_likelihood_ratio (const feature_edge&, const feature_type&,
+                                          std::size_t stride = 1, std::size_t offset = 0) const;
         double obs_likelihood_ratio (const feature_estimate&, timestep_type obs_timestep,
-                                    feature_obs_range obs_range, feature_type new_obs) const;
+                                    feature_obs_range obs_range, feature_type new_obs,
+                                    std::size_t stride = 1, std::size_t offset = 0) const;
+
+        /** Adds to log_ratio[c] the log likelihood ratio of the observations in obs_range for
+         chain c, whose new and old feature positions relative to obs_timestep are new_obs[c] and
+         old_obs[c]. Each observation model is read once for all the chains, and the likelihoods
+         of all the chains are evaluated together. */
+        static void lockstep_obs_ratios (mcmc_slam* const chains[], std::size_t n, timestep_type obs_timestep,
+                                         feature_obs_range obs_range, feature_type new_obs[],
+                                         feature_type old_obs[], double log_ratio[]);
+
+        static std::size_t update_state_lockstep (mcmc_slam* const chains[], std::size_t n, timestep_type);
+        static std::size_t update_feature_lockstep (mcmc_slam* const chains[], std::size_t n, std::size_t index);
+
+        /** The state edges [first, last) whose change could alter the log likelihood ratio of a
+         change to edge t: edge t and the observation spans of the features seen on both sides of it */
+        auto influence (timestep_type t) const -> std::pair<timestep_type, timestep_type>;
 
         bool initialiser_available (timestep_type t) const {
             return initialiser && (initialiser->timestep(t), true);
         }
 
+        /** Capped so that edges far from their proposal, such as features re-rooted to a time
+         step whose observation disagrees with them, cannot overflow the weight trees. */
         static double edge_log_weight (double edge_log_likelihood, double edge_dim) {
-            return std::log(edge_dim) - edge_log_likelihood/edge_dim;
+            const double log_weight = std::log(edge_dim) - edge_log_likelihood/edge_dim;
+            return log_weight < 100 ? log_weight : 100;
         }
 
     public:
@@ -172,8 +393,84 @@ namespace slam {
 
         void set_initialiser (const decltype(initialiser)& init) { initialiser = init; }
 
+        /** Enables delayed acceptance with the given surrogate stride, or disables it if at most one */
+        void set_delayed_acceptance (unsigned int stride) { surrogate_stride = std::max (stride, 1u); }
+
+        /** Proposes state edges that have observations at their end from the unscented filter with
+         the given probability, and otherwise from the control model */
+        void set_ukf_proposal (double weight, double alpha, double beta, double kappa) {
+            ukf_weight = weight;
+            ukf_params = unscented_params<ControlModel::vector_dim> (alpha, beta, kappa);
+        }
+
+        /** Mixes adaptive random walk proposals into update() with the given probability, adapting
+         them during the first burn_in updates */
+        void set_random_walk (double weight, std::size_t burn_in) {
+            if (!(weight >= 0 && weight < 1)) {
+                std::cerr << "Random walk proposal weight must be at least 0 and below 1\n";
+                std::exit (EXIT_FAILURE);
+            }
+            walk_weight = weight;
+            walk_burn_in = burn_in;
+        }
+
+        /** Re-roots features every interval time steps, or never if the interval is zero */
+        void set_reroot_interval (unsigned int interval) { reroot_interval = interval; }
+
+        void set_schedule (schedule_type s) { schedule = s; scan_order.clear(); scan_position = 0; }
+
+        /** Enables the sequential test for feature edges if epsilon is positive */
+        void set_austerity (double epsilon, unsigned int batch) {
+            austerity_epsilon = epsilon;
+            austerity_batch = std::max (batch, 2u);
+        }
+
+        /** Readers on other threads get the latest published estimate from here without
+         synchronising with the sampler; publish_snapshot must be called on the sampler's thread. */
+        auto get_snapshots () const -> std::shared_ptr<snapshot_cell> { return snapshots; }
+
+        void publish_snapshot ();
+
         bool update ();
 
+        /** Update the given edge rather than one selected by edge weight. Scanning the edges in
+         any order that does not depend on their values leaves the posterior invariant. */
+        bool update_state (timestep_type t) {
+            return update (state_edge (*this, t), false);
+        }
+
+        bool update_feature (featureid_type id) {
+            return update (feature_edge (*this, feature_index.at (id)), false);
+        }
+
+        /** Updates every feature edge once, in parallel on the given pool, with the trajectory held
+         fixed. Given the trajectory the features are independent, so this is a scan of independent
+         Metropolis-Hastings updates. Features are split into fixed blocks, each with a random stream
+         seeded from this chain's, and the changes to the log likelihood and edge weights are applied
+         in block order, so the result does not depend on the number of threads. Returns the number
+         of accepted updates. */
+        std::size_t sweep_features (utility::thread_pool&);
+
+        /** Performs count state edge updates, at edges chosen uniformly at random, evaluating
+         batches of proposals in parallel against the current estimate. The proposals are then
+         committed in order, and a proposal is evaluated again if an edge within its influence
+         was changed earlier in the batch, so the result is that of plain independence proposals
+         from the control proposal applied one at a time, whatever the number of threads. Delayed
+         acceptance, the sequential test and the UKF and random-walk proposals are not used.
+         Returns the number of accepted updates. */
+        std::size_t update_states_speculative (utility::thread_pool&, std::size_t count);
+
+        /** The most chains that update_lockstep accepts */
+        static const std::size_t max_lockstep = 8;
+
+        /** Updates the same edge in each of the n chains, which must share their data and have the
+         same current time step. The edge is chosen with the given random source: a state or a
+         feature edge with equal probability, then one of that kind uniformly. Each chain draws its
+         own proposal and makes its own accept decision with its own random source, so each chain
+         alone is a valid sampler, but the observation likelihoods of all the chains are evaluated
+         in one pass over the shared observations. Returns the number of accepted updates. */
+        static std::size_t update_lockstep (mcmc_slam* const chains[], std::size_t n, random_source&);
+
         // Overridden virtual member functions of slam::slam_result
 
         virtual void timestep (timestep_type) override;
@@ -198,11 +495,68 @@ namespace slam {
 
         virtual const feature_map_type& get_feature_map () const override;
 
+        virtual std::size_t trajectory_revision () const override {
+            return revision;
+        }
+
+    protected:
+
+        virtual void export_states_impl (timestep_type first, timestep_type last, state_type* out) const override {
+            state_estimates.accumulate_range (first, last, out);
+        }
+
+        virtual void export_features_impl (feature_map_type&) const override;
+
+    public:
+
         class updater : public timestep_listener {
 
             std::shared_ptr<mcmc_slam> instance;
             unsigned int steps, end_steps;
 
+            // Called with the current sample every sample_thin updates, if set
+            std::function<void(const mcmc_slam&)> sample_listener;
+            unsigned int sample_thin = 0;
+            unsigned long num_updates = 0;
+
+            // Publish a snapshot every snapshot_interval updates, if nonzero
+            unsigned int snapshot_interval = 0;
+
+            // Sweep the features in parallel every sweep_interval updates, if nonzero
+            unsigned int sweep_interval = 0;
+            std::unique_ptr<utility::thread_pool> sweep_pool;
+
+            // State edge updates evaluated speculatively in parallel after each time step's updates
+            unsigned int speculative_steps = 0, speculative_end_steps = 0;
+            std::unique_ptr<utility::thread_pool> speculative_pool;
+
+            bool update () {
+                const bool accepted = instance->update();
+                ++num_updates;
+                if (sweep_interval && num_updates % sweep_interval == 0) instance->sweep_features (*sweep_pool);
+                if (sample_listener && num_updates % sample_thin == 0) sample_listener (*instance);
+                if (snapshot_interval && num_updates % snapshot_interval == 0) instance->publish_snapshot();
+                return accepted;
+            }
+
+            /** Logs the acceptance rate of the final updates, and the effective sample size of the
+             log likelihoods after each of them per CPU second */
+#if defined(SLAM_COUNTERS) || SLAM_LOG_MIN_LEVEL <= 1
+            static void report_end_steps (const std::vector<double>& log_likelihoods, std::size_t accepted,
+                                          double cpu_seconds) {
+                const double acceptance = double (accepted) / log_likelihoods.size();
+                const double ess = utility::effective_sample_size (log_likelihoods);
+                const double ess_rate = cpu_seconds > 0 ? ess / cpu_seconds : 0;
+                SLAM_GAUGE (mcmc_end_acceptance, acceptance);
+                SLAM_GAUGE (mcmc_end_ess, ess);
+                SLAM_GAUGE (mcmc_end_ess_per_cpu_second, ess_rate);
+                SLAM_LOG_INFO ("mcmc_slam.end_steps", {{"steps", log_likelihoods.size()},
+                    {"acceptance", acceptance}, {"ess", ess}, {"ess_per_cpu_second", ess_rate}});
+            }
+#else
+            static void report_end_steps (const std::vector<double>&, std::size_t, double) { }
+#endif
+
         public:
 
             updater (const decltype(instance)& instance, unsigned int steps=0, unsigned int end_steps=0)
@@ -210,14 +564,53 @@ namespace slam {
 
             updater (const decltype(instance)&, const boost::program_options::variables_map&);
 
+            void set_sample_listener (const decltype(sample_listener)& f, unsigned int thin) {
+                sample_listener = f;
+                sample_thin = std::max (thin, 1u);
+            }
+
+            void set_snapshot_interval (unsigned int interval) { snapshot_interval = interval; }
+
+            /** Interleaves a parallel feature sweep after every interval updates (0 to disable) */
+            void set_feature_sweep (unsigned int interval, unsigned int threads) {
+                sweep_interval = interval;
+                sweep_pool.reset (interval ? new utility::thread_pool (threads) : nullptr);
+            }
+
+            /** Adds speculative state edge updates after each time step's and the final updates */
+            void set_speculative_steps (unsigned int steps, unsigned int end_steps, unsigned int threads) {
+                speculative_steps = steps;
+                speculative_end_steps = end_steps;
+                speculative_pool.reset (steps || end_steps ? new utility::thread_pool (threads) : nullptr);
+            }
+
+            /** Performs count updates, with the sample listener and snapshots as configured */
+            unsigned int run (unsigned int count) {
+                for (unsigned int i = 0; i < count; ++i) update();
+                return count;
+            }
+
             virtual void timestep (timestep_type t) override {
                 instance->timestep (t);
-                for (unsigned int i = 0; i < steps; ++i) instance->update();
+                SLAM_TRACE_SCOPE ("mcmc_slam::update", "steps", steps);
+                for (unsigned int i = 0; i < steps; ++i) update();
+                if (speculative_steps) instance->update_states_speculative (*speculative_pool, speculative_steps);
             }
 
             virtual void completed () override {
                 instance->completed();
-                for (unsigned int i = 0; i < end_steps; ++i) instance->update();
+                SLAM_TRACE_SCOPE ("mcmc_slam::update", "steps", end_steps);
+                std::vector<double> log_likelihoods;
+                log_likelihoods.reserve (end_steps);
+                std::size_t accepted = 0;
+                const std::clock_t start = std::clock();
+                for (unsigned int i = 0; i < end_steps; ++i) {
+                    if (update()) ++accepted;
+                    log_likelihoods.push_back (instance->get_log_likelihood());
+                }
+                if (end_steps) report_end_steps (log_likelihoods, accepted, double (std::clock() - start) / CLOCKS_PER_SEC);
+                if (speculative_end_steps) instance->update_states_speculative (*speculative_pool, speculative_end_steps);
+                if (snapshot_interval) instance->publish_snapshot();
             }
         };
 
@@ -273,6 +666,7 @@ void slam::mcmc_slam<ControlModel, ObservationModel>
 ::timestep (const timestep_type timestep) {
 
     assert (timestep <= data->current_timestep());
+    SLAM_TRACE_SCOPE ("mcmc_slam::timestep", "timestep", timestep);
     using namespace boost::adaptors;
 
     while (next_timestep <= timestep) {
@@ -303,7 +697,8 @@ void slam::mcmc_slam<ControlModel, ObservationModel>
                 log_likelihood += observation.log_likelihood (ObservationModel::observe (estimate));
                 assert (std::isfinite (log_likelihood));
 
-                if (observation.more_accurate_than (f.observations().at (f.parent_timestep))) {
+                // Re-rooting places parents by position rather than by accuracy
+                if (reroot_interval == 0 && observation.more_accurate_than (f.observations().at (f.parent_timestep))) {
 
                     //std::cout << "Changing parent of feature " << size_t(f.id()) << " to timestep "
                     //<< size_t(t) << "... " << std::flush;
@@ -325,6 +720,89 @@ void slam::mcmc_slam<ControlModel, ObservationModel>
 
         assert (next_timestep == current_timestep());
         ++next_timestep;
+
+        if (reroot_interval > 0 && next_timestep % reroot_interval == 0) reroot_features();
+    }
+}
+
+
+template <class ControlModel, class ObservationModel>
+void slam::mcmc_slam<ControlModel, ObservationModel>
+::reroot_features () {
+
+    SLAM_TRACE_SCOPE ("mcmc_slam::reroot_features", "features", feature_estimates.size());
+
+    for (std::size_t i = 0; i < feature_estimates.size(); ++i) {
+
+        feature_estimate& f = feature_estimates[i];
+        const auto& observations = f.observations();
+        const auto median = observations.begin()[(observations.size() - 1) / 2];
+        if (median.first == f.parent_timestep) continue;
+
+        f.estimate = state_estimates.accumulate (median.first, f.parent_timestep) + f.estimate;
+        f.parent_timestep = median.first;
+
+        SLAM_COUNT (feature_reroots);
+
+        // As when a more accurate observation arrives, try a draw from the new parent's observation
+        if (!update (feature_edge (*this, i), false)) {
+            const auto& proposal = median.second.proposal();
+            feature_weights[i] = std::exp (edge_log_weight (proposal.log_likelihood (f.estimate), proposal.vector_dim));
+        }
+    }
+}
+
+
+template <class ControlModel, class ObservationModel>
+auto slam::mcmc_slam<ControlModel, ObservationModel>
+::parse_schedule (const std::string& name) -> schedule_type {
+    if (name == "random") return random_scan;
+    if (name == "sweep") return sweep;
+    if (name == "random-sweep") return random_sweep;
+    if (name == "blocked") return blocked;
+    std::cerr << "Unknown MCMC schedule: " << name << std::endl;
+    std::exit (EXIT_FAILURE);
+}
+
+
+template <class ControlModel, class ObservationModel>
+auto slam::mcmc_slam<ControlModel, ObservationModel>
+::update_scheduled () -> bool {
+
+    if (scan_position == scan_order.size()) start_scan();
+    if (scan_order.empty()) return false;
+
+    const std::size_t edge = scan_order[scan_position++];
+    return edge < scan_states
+    ? update (state_edge (*this, timestep_type (edge)), false)
+    : update (feature_edge (*this, edge - scan_states), false);
+}
+
+
+template <class ControlModel, class ObservationModel>
+void slam::mcmc_slam<ControlModel, ObservationModel>
+::start_scan () {
+
+    // Edges added during a pass are visited from the next one
+    scan_states = current_timestep();
+    scan_order.resize (scan_states + feature_estimates.size());
+    scan_position = 0;
+    for (std::size_t i = 0; i < scan_order.size(); ++i) scan_order[i] = i;
+
+    // State edge t lies between the features with parents t and t+1; blocked puts the states last
+    const std::size_t state_offset = schedule == blocked ? 2 * (scan_states + 1) : 0;
+    const auto key = [&](std::size_t edge) -> std::size_t {
+        return edge < scan_states
+        ? 2 * edge + 1 + state_offset
+        : 2 * std::size_t (feature_estimates[edge - scan_states].parent_timestep);
+    };
+    std::sort (scan_order.begin(), scan_order.end(), [&](std::size_t a, std::size_t b) {
+        const std::size_t key_a = key (a), key_b = key (b);
+        return key_a < key_b || (key_a == key_b && a < b);
+    });
+
+    if (schedule == random_sweep && !scan_order.empty()) {
+        std::rotate (scan_order.begin(), scan_order.begin() + random() % scan_order.size(), scan_order.end());
     }
 }
 
@@ -334,6 +812,8 @@ template <class ControlModel, class ObservationModel>
 auto slam::mcmc_slam<ControlModel, ObservationModel>
 ::update () -> bool {
 
+    if (schedule != random_scan) return update_scheduled();
+
     const double state_weight = state_weights.accumulate();
     const double feature_weight = feature_weights.accumulate();
 
@@ -343,7 +823,8 @@ auto slam::mcmc_slam<ControlModel, ObservationModel>
 
         timestep_type timestep;
         do { timestep = timestep_type (state_weights.binary_search (state_weight*random.uniform())); }
-        while (timestep >= current_timestep() && ((std::cerr << "stuck in timestep select loop\n"), true));
+        while (timestep >= current_timestep()
+               && (SLAM_LOG_WARNING ("mcmc_slam.timestep_select_retry", {{"timestep", timestep}}), true));
 
         return update (state_edge (*this, timestep), true);
     }
@@ -351,7 +832,8 @@ auto slam::mcmc_slam<ControlModel, ObservationModel>
 
         std::size_t index;
         do { index = feature_weights.binary_search (feature_weight*random.uniform()); }
-        while (index >= feature_estimates.size() && ((std::cerr << "stuck in landmark select loop\n"), true));
+        while (index >= feature_estimates.size()
+               && (SLAM_LOG_WARNING ("mcmc_slam.landmark_select_retry", {{"index", index}}), true));
 
         return update (feature_edge (*this, index), true);
     }
@@ -363,23 +845,29 @@ template <class EdgeType>
 auto slam::mcmc_slam<ControlModel, ObservationModel>
 ::update (EdgeType&& edge, bool use_edge_weight) -> bool {
 
-    const auto& proposal = edge.distribution.proposal();
-    const auto proposed = proposal(random);
+    const bool adapting = walk_weight > 0 && walk_updates < walk_burn_in;
+    if (adapting) ++walk_updates;
 
-    const double new_proposal_log_likelihood = proposal.log_likelihood (proposed);
-    const double old_proposal_log_likelihood = proposal.log_likelihood (edge.estimate);
-    const double proposal_log_ratio = new_proposal_log_likelihood - old_proposal_log_likelihood;
+    double proposal_log_ratio;
+    const auto proposed = propose (edge, proposal_log_ratio);
+    // A random walk step out of the domain of the coordinates has zero density
+    if (walk_proposed && !walk_in_domain) {
+        count_update (edge, false);
+        return false;
+    }
     assert (std::isfinite (proposal_log_ratio));
 
-    const double log_ratio = edge_log_likelihood_ratio (edge, proposed);
-    assert (std::isfinite (log_ratio));
+    // Edge weights depend only on the value of the edge, whichever proposal was used
+    const auto& proposal = edge.distribution.proposal();
+    const double new_proposal_log_likelihood = proposal.log_likelihood (proposed);
+    const double old_proposal_log_likelihood = proposal.log_likelihood (edge.estimate);
 
     const double new_log_weight = edge_log_weight (new_proposal_log_likelihood, proposal.vector_dim);
     const double new_weight = std::exp (new_log_weight);
     assert (std::isfinite (new_weight));
 
     double normaliser = 1.0;
-    double accept_log_ratio = log_ratio - proposal_log_ratio;
+    double accept_log_ratio = -proposal_log_ratio;
 
     if (use_edge_weight) {
         const double old_log_weight = edge_log_weight (old_proposal_log_likelihood, proposal.vector_dim);
@@ -389,13 +877,42 @@ auto slam::mcmc_slam<ControlModel, ObservationModel>
         accept_log_ratio += new_log_weight - old_log_weight;
     }
 
-    //std::cout << std::min(1.0,std::exp(accept_log_ratio)/normaliser) << '\n';
+    // The proposal is accepted if the log likelihood ratio exceeds this
+    double threshold;
+
+    if (surrogate_stride > 1) {
+
+        // Delayed acceptance: the first stage is a Metropolis-Hastings test with the surrogate in
+        // place of the likelihood, and the second corrects for the surrogate's error. The subset is
+        // chosen independently of the state, so the combined kernel leaves the exact target invariant.
+        const std::size_t offset = random() % surrogate_stride;
+        const double surrogate_log_ratio = edge_log_likelihood_ratio (edge, proposed, surrogate_stride, offset);
+        assert (std::isfinite (surrogate_log_ratio));
+
+        if (!(normaliser*random.uniform() < std::exp (accept_log_ratio + surrogate_log_ratio))) {
+            SLAM_COUNT (surrogate_rejects);
+            count_update (edge, false);
+            return false;
+        }
 
-    if (normaliser*random.uniform() < std::exp (accept_log_ratio)) {
+        threshold = std::log (random.uniform()) + surrogate_log_ratio;
+    }
+    else {
+        threshold = std::log (normaliser*random.uniform()) - accept_log_ratio;
+    }
+
+    double log_ratio;
+    const bool accepted = likelihood_test (edge, proposed, threshold, log_ratio);
+    count_update (edge, accepted);
+    if (accepted && walk_proposed) SLAM_COUNT (walk_accepts);
+
+    if (accepted) {
+        if (adapting) walk (edge).add_move (edge.estimate, proposed);
         edge.estimate = proposed;
         edge.weight = new_weight;
         log_likelihood += log_ratio;
         map_estimate.clear();
+        edge_changed (edge);
         return true;
     }
     else {
@@ -404,6 +921,515 @@ auto slam::mcmc_slam<ControlModel, ObservationModel>
 }
 
 
+template <class ControlModel, class ObservationModel>
+auto slam::mcmc_slam<ControlModel, ObservationModel>
+::propose (const feature_edge& edge, double& proposal_log_ratio) -> feature_type {
+    const auto& proposal = edge.distribution.proposal();
+    const bool use_walk = walk_weight > 0 && bool (feature_walk);
+
+    walk_proposed = use_walk && random.uniform() < walk_weight;
+    if (walk_proposed) SLAM_COUNT (walk_proposals);
+    const feature_type proposed = walk_proposed ? feature_walk (edge.estimate, random, walk_in_domain) : proposal (random);
+
+    const double new_log_likelihood = proposal.log_likelihood (proposed);
+    const double old_log_likelihood = proposal.log_likelihood (edge.estimate);
+    proposal_log_ratio = use_walk
+    ? walk_mixture_log_ratio (feature_walk.log_likelihood (edge.estimate, proposed), new_log_likelihood, old_log_likelihood)
+    : new_log_likelihood - old_log_likelihood;
+    return proposed;
+}
+
+
+/** The proposal is a mixture of the unscented filter's distribution and the control model, both
+ over control vectors, so its density is that of the mixture at the observed control. */
+template <class ControlModel, class ObservationModel>
+auto slam::mcmc_slam<ControlModel, ObservationModel>
+::propose (const state_edge& edge, double& proposal_log_ratio) -> state_type {
+
+    const auto& proposal = edge.distribution.proposal();
+    control_dist ukf;
+    const bool use_ukf = ukf_weight > 0 && ukf_proposal (edge.timestep, ukf);
+    const bool use_walk = walk_weight > 0 && bool (state_walk);
+
+    walk_proposed = use_walk && random.uniform() < walk_weight;
+    if (walk_proposed) SLAM_COUNT (walk_proposals);
+    const bool from_ukf = !walk_proposed && use_ukf && random.uniform() < ukf_weight;
+    if (from_ukf) SLAM_COUNT (ukf_proposals);
+
+    const state_type proposed = walk_proposed ? state_walk (edge.estimate, random, walk_in_domain)
+    : from_ukf ? ControlModel::inv_observe (ukf (random))
+    : proposal (random);
+
+    const auto independent_log_likelihood = [&](const state_type& x) {
+        if (!use_ukf) return proposal.log_likelihood (x);
+        return log_sum_exp (std::log (ukf_weight) + ukf.log_likelihood (ControlModel::observe (x)),
+                            std::log1p (-ukf_weight) + proposal.log_likelihood (x));
+    };
+
+    const double new_log_likelihood = independent_log_likelihood (proposed);
+    const double old_log_likelihood = independent_log_likelihood (edge.estimate);
+    proposal_log_ratio = use_walk
+    ? walk_mixture_log_ratio (state_walk.log_likelihood (edge.estimate, proposed), new_log_likelihood, old_log_likelihood)
+    : new_log_likelihood - old_log_likelihood;
+    return proposed;
+}
+
+
+template <class ControlModel, class ObservationModel>
+auto slam::mcmc_slam<ControlModel, ObservationModel>
+::ukf_proposal (timestep_type t, control_dist& dist) const -> bool {
+
+    using observer = typename vector_transform_functors<ControlModel, ObservationModel>::control_observer;
+
+    const ControlModel& control = data->control (t);
+    dist.mean() = control.mean();
+    dist.chol_cov() = control.chol_cov();
+
+    bool conditioned = false;
+    for (const auto& obs : boost::adaptors::values (data->observations_at (t+1))) {
+
+        const auto index = feature_index.find (obs.id());
+        if (index == feature_index.end()) continue;
+
+        // Features whose parent is after t move with this edge, so they say nothing about it
+        const feature_estimate& f = feature_estimates[index->second];
+        if (t < f.parent_timestep) continue;
+
+        const feature_type feature = state_estimates.accumulate (t, f.parent_timestep) + f.estimate;
+        unscented_update (ukf_params, observer (feature), dist, obs.observation());
+        conditioned = true;
+    }
+    return conditioned;
+}
+
+
+template <class ControlModel, class ObservationModel>
+auto slam::mcmc_slam<ControlModel, ObservationModel>
+::likelihood_test (const state_edge& edge, const state_type& proposed, double threshold, double& log_ratio) -> bool {
+    log_ratio = edge_log_likelihood_ratio (edge, proposed);
+    assert (std::isfinite (log_ratio));
+    SLAM_COUNT (exact_evaluations);
+    return log_ratio > threshold;
+}
+
+
+template <class ControlModel, class ObservationModel>
+auto slam::mcmc_slam<ControlModel, ObservationModel>
+::likelihood_test (const feature_edge& edge, const feature_type& proposed, double threshold, double& log_ratio) -> bool {
+
+    const bool sequential = austerity_epsilon > 0 && edge.feature.observations().size() > austerity_batch;
+    if (sequential && !sequential_test (edge, proposed, threshold)) return false;
+
+    // Moves passing the sequential test are checked exactly, so it can only cause false rejects,
+    // and accepted moves need the exact ratio to keep log_likelihood up to date
+    log_ratio = edge_log_likelihood_ratio (edge, proposed);
+    assert (std::isfinite (log_ratio));
+    SLAM_COUNT (exact_evaluations);
+    return log_ratio > threshold;
+}
+
+
+template <class ControlModel, class ObservationModel>
+auto slam::mcmc_slam<ControlModel, ObservationModel>
+::sequential_test (const feature_edge& edge, const feature_type& proposed, double threshold) -> bool {
+
+    const feature_observations& observations = edge.feature.observations();
+    const std::size_t size = observations.size();
+    const double mean_threshold = threshold / size;
+
+    // sample_order is the identity between tests, and only grows with the largest feature
+    while (sample_order.size() < size) sample_order.push_back (sample_order.size());
+    sample_swaps.clear();
+
+    // Undoes this test's swaps, so the cost stays proportional to the sample size
+    const auto decide = [&](bool accept) {
+        for (std::size_t k = sample_swaps.size(); k-- > 0; ) std::swap (sample_order[k], sample_order[sample_swaps[k]]);
+        return accept;
+    };
+
+    double sum = 0, sum_squares = 0;
+    std::size_t n = 0;
+
+    while (true) {
+
+        // Extend the sample without replacement by a partial Fisher-Yates shuffle
+        const std::size_t batch_end = std::min (size, n + austerity_batch);
+        SLAM_COUNT_N (likelihood_terms, 2 * (batch_end - n));
+        for (; n < batch_end; ++n) {
+            sample_swaps.push_back (n + random() % (size - n));
+            std::swap (sample_order[n], sample_order[sample_swaps.back()]);
+            const auto& obs = *(observations.begin() + sample_order[n]);
+            const state_type state_change = state_estimates.accumulate (obs.first, edge.feature.parent_timestep);
+            const ObservationModel& obs_model = obs.second;
+            const double term
+            = obs_model.log_likelihood (ObservationModel::observe (state_change + proposed))
+            - obs_model.log_likelihood (ObservationModel::observe (state_change + edge.feature.estimate));
+            sum += term;
+            sum_squares += term * term;
+        }
+
+        const double mean = sum / n;
+        if (n == size) return decide (mean > mean_threshold);
+
+        // Standard error of the mean, with the finite population correction
+        const double variance = std::max (sum_squares / n - mean * mean, 0.0) * n / (n - 1);
+        const double std_error = std::sqrt (variance / n * (1 - double (n - 1) / (size - 1)));
+        if (std_error == 0) return decide (mean > mean_threshold);
+
+        const double t = std::abs (mean - mean_threshold) / std_error;
+        const boost::math::students_t distribution (double (n - 1));
+        if (boost::math::cdf (boost::math::complement (distribution, t)) < austerity_epsilon) {
+            return decide (mean > mean_threshold);
+        }
+    }
+}
+
+
+template <class ControlModel, class ObservationModel>
+auto slam::mcmc_slam<ControlModel, ObservationModel>
+::sweep_features (utility::thread_pool& pool) -> std::size_t {
+
+    // Features per block; each block is one task for the pool
+    const std::size_t block_size = 64;
+
+    const std::size_t size = feature_estimates.size();
+    const std::size_t num_blocks = (size + block_size - 1) / block_size;
+    SLAM_TRACE_SCOPE ("mcmc_slam::sweep_features", "features", size);
+
+    struct block {
+        random_source::result_type seed;
+        double log_ratio = 0;
+        std::size_t accepted = 0;
+    };
+
+    std::vector<block> blocks (num_blocks);
+    for (auto& b : blocks) b.seed = random();
+
+    // Edge weights of the accepted proposals, NaN for the rest
+    std::vector<double> new_weights (size, std::numeric_limits<double>::quiet_NaN());
+
+    pool.parallel_for (num_blocks, [&](std::size_t b, unsigned int) {
+
+        random_source block_random (blocks[b].seed);
+        const std::size_t end = std::min (size, (b+1) * block_size);
+
+        for (std::size_t i = b * block_size; i < end; ++i) {
+
+            feature_estimate& f = feature_estimates[i];
+            const auto& proposal = f.observations().at (f.parent_timestep).proposal();
+            const feature_type proposed = proposal (block_random);
+
+            const double new_proposal_log_likelihood = proposal.log_likelihood (proposed);
+            const double proposal_log_ratio = new_proposal_log_likelihood - proposal.log_likelihood (f.estimate);
+            assert (std::isfinite (proposal_log_ratio));
+
+            const double log_ratio = obs_likelihood_ratio (f, f.parent_timestep, f.observations(), proposed);
+            assert (std::isfinite (log_ratio));
+            SLAM_COUNT (exact_evaluations);
+
+            const bool accepted = log_ratio > std::log (block_random.uniform()) + proposal_log_ratio;
+            SLAM_COUNT (feature_proposals);
+
+            if (accepted) {
+                SLAM_COUNT (feature_accepts);
+                f.estimate = proposed;
+                new_weights[i] = std::exp (edge_log_weight (new_proposal_log_likelihood, proposal.vector_dim));
+                blocks[b].log_ratio += log_ratio;
+                ++blocks[b].accepted;
+            }
+        }
+    });
+
+    std::size_t accepted = 0;
+    for (const auto& b : blocks) {
+        log_likelihood += b.log_ratio;
+        accepted += b.accepted;
+    }
+    for (std::size_t i = 0; i < size; ++i) {
+        if (!std::isnan (new_weights[i])) feature_weights[i] = new_weights[i];
+    }
+
+    if (accepted) map_estimate.clear();
+    return accepted;
+}
+
+
+template <class ControlModel, class ObservationModel>
+auto slam::mcmc_slam<ControlModel, ObservationModel>
+::influence (timestep_type t) const -> std::pair<timestep_type, timestep_type> {
+
+    timestep_type first = t, last = t+1;
+
+    for (const feature_estimate& f : feature_estimates) {
+        const feature_observations& observations = f.observations();
+        const timestep_type observed_first = observations.begin()->first;
+        const timestep_type observed_last = (observations.end()-1)->first;
+        if (observed_first <= t && t < observed_last) {
+            first = std::min (first, observed_first);
+            last = std::max (last, observed_last);
+        }
+    }
+
+    return {first, last};
+}
+
+
+template <class ControlModel, class ObservationModel>
+auto slam::mcmc_slam<ControlModel, ObservationModel>
+::update_states_speculative (utility::thread_pool& pool, std::size_t count) -> std::size_t {
+
+    const std::size_t num_edges = current_timestep();
+    if (num_edges == 0) return 0;
+    SLAM_TRACE_SCOPE ("mcmc_slam::update_states_speculative", "updates", count);
+
+    struct move {
+        timestep_type timestep;
+        state_type proposed;
+        double log_uniform;
+        double log_ratio;
+        std::pair<timestep_type, timestep_type> influence;
+    };
+
+    // Larger batches keep more threads busy but are more likely to need re-evaluation. The size
+    // is fixed, since which proposals are re-evaluated changes the rounding of their ratios
+    const std::size_t batch_size = 16;
+
+    std::vector<move> batch;
+    std::vector<timestep_type> changed;
+    std::size_t accepted = 0;
+
+    std::uniform_int_distribution<std::size_t> edge_dist (0, num_edges-1);
+
+    for (std::size_t done = 0; done < count; done += batch.size()) {
+
+        // Every random draw is made here, in the order update_state would make them
+        batch.resize (std::min (batch_size, count - done));
+        for (move& m : batch) {
+            m.timestep = timestep_type (edge_dist (random));
+            m.proposed = data->control (m.timestep).proposal() (random);
+            m.log_uniform = std::log (random.uniform());
+        }
+
+        pool.parallel_for (batch.size(), [&](std::size_t k, unsigned int) {
+            move& m = batch[k];
+            m.log_ratio = edge_log_likelihood_ratio (state_edge (*this, m.timestep), m.proposed);
+            m.influence = influence (m.timestep);
+        });
+
+        changed.clear();
+        for (move& m : batch) {
+
+            state_edge edge (*this, m.timestep);
+
+            const bool stale = std::any_of (changed.begin(), changed.end(), [&](timestep_type t) {
+                return !(t < m.influence.first) && t < m.influence.second;
+            });
+            if (stale) {
+                SLAM_COUNT (speculative_retries);
+                m.log_ratio = edge_log_likelihood_ratio (edge, m.proposed);
+            }
+            assert (std::isfinite (m.log_ratio));
+            SLAM_COUNT (exact_evaluations);
+
+            const auto& proposal = edge.distribution.proposal();
+            const double new_proposal_log_likelihood = proposal.log_likelihood (m.proposed);
+            const double proposal_log_ratio = new_proposal_log_likelihood - proposal.log_likelihood (edge.estimate);
+            assert (std::isfinite (proposal_log_ratio));
+
+            const bool accept = m.log_ratio > m.log_uniform + proposal_log_ratio;
+            count_update (edge, accept);
+
+            if (accept) {
+                edge.estimate = m.proposed;
+                edge.weight = std::exp (edge_log_weight (new_proposal_log_likelihood, proposal.vector_dim));
+                log_likelihood += m.log_ratio;
+                edge_changed (edge);
+                changed.push_back (m.timestep);
+                ++accepted;
+            }
+        }
+    }
+
+    if (accepted) map_estimate.clear();
+    return accepted;
+}
+
+
+template <class ControlModel, class ObservationModel>
+auto slam::mcmc_slam<ControlModel, ObservationModel>
+::update_lockstep (mcmc_slam* const chains[], std::size_t n, random_source& random) -> std::size_t {
+
+    assert (0 < n && n <= max_lockstep);
+    const mcmc_slam& first = *chains[0];
+    for (std::size_t c = 1; c < n; ++c) {
+        assert (chains[c]->data == first.data);
+        assert (chains[c]->current_timestep() == first.current_timestep());
+    }
+
+    const std::size_t num_states = first.current_timestep();
+    const std::size_t num_features = first.feature_estimates.size();
+    if (num_states == 0 && num_features == 0) return 0;
+
+    // The edge weights differ between chains, so each kind of edge is chosen half the time
+    const bool state = num_features == 0 || (num_states > 0 && random.uniform() < 0.5);
+    return state
+    ? update_state_lockstep (chains, n, timestep_type (std::uniform_int_distribution<std::size_t> (0, num_states-1) (random)))
+    : update_feature_lockstep (chains, n, std::uniform_int_distribution<std::size_t> (0, num_features-1) (random));
+}
+
+
+template <class ControlModel, class ObservationModel>
+void slam::mcmc_slam<ControlModel, ObservationModel>
+::lockstep_obs_ratios (mcmc_slam* const chains[], std::size_t n, timestep_type obs_timestep,
+                       feature_obs_range obs_range, feature_type new_obs[],
+                       feature_type old_obs[], double log_ratio[]) {
+
+    static const int dim = ObservationModel::vector_dim;
+    using observed_type = Eigen::Matrix<double, dim, Eigen::Dynamic, dim == 1 ? Eigen::RowMajor : Eigen::ColMajor,
+                                        dim, max_lockstep>;
+    using ratio_type = Eigen::Array<double, 1, Eigen::Dynamic, Eigen::RowMajor, 1, max_lockstep>;
+
+    observed_type observed_new (dim, n), observed_old (dim, n);
+    ratio_type sum = ratio_type::Zero (n);
+
+    for (const auto& obs : obs_range) {
+
+        for (std::size_t c = 0; c < n; ++c) {
+            const state_type state_change = chains[c]->state_estimates.accumulate (obs.first, obs_timestep);
+            new_obs[c] = state_change + new_obs[c];
+            old_obs[c] = state_change + old_obs[c];
+            observed_new.col(c) = ObservationModel::observe (new_obs[c]);
+            observed_old.col(c) = ObservationModel::observe (old_obs[c]);
+        }
+        obs_timestep = obs.first;
+
+        const ObservationModel& obs_model = obs.second;
+        sum += obs_model.likelihood_exponents (observed_new) - obs_model.likelihood_exponents (observed_old);
+    }
+
+    SLAM_COUNT_N (likelihood_terms, 2 * n * obs_range.size());
+    for (std::size_t c = 0; c < n; ++c) log_ratio[c] += sum(c);
+}
+
+
+template <class ControlModel, class ObservationModel>
+auto slam::mcmc_slam<ControlModel, ObservationModel>
+::update_state_lockstep (mcmc_slam* const chains[], std::size_t n, timestep_type t) -> std::size_t {
+
+    const ControlModel& control = chains[0]->data->control (t);
+    const auto& proposal = control.proposal();
+
+    state_type proposed[max_lockstep];
+    double threshold[max_lockstep], new_log_weight[max_lockstep], log_ratio[max_lockstep];
+
+    for (std::size_t c = 0; c < n; ++c) {
+        mcmc_slam& chain = *chains[c];
+        const state_type estimate = chain.state_estimates[t];
+        proposed[c] = proposal (chain.random);
+        const double new_proposal_log_likelihood = proposal.log_likelihood (proposed[c]);
+        threshold[c] = std::log (chain.random.uniform()) + new_proposal_log_likelihood - proposal.log_likelihood (estimate);
+        new_log_weight[c] = edge_log_weight (new_proposal_log_likelihood, proposal.vector_dim);
+        log_ratio[c] = control.log_likelihood (ControlModel::observe (proposed[c]))
+        - control.log_likelihood (ControlModel::observe (estimate));
+    }
+    SLAM_COUNT_N (likelihood_terms, 2 * n);
+
+    feature_type new_obs[max_lockstep], old_obs[max_lockstep];
+
+    for (std::size_t i = 0; i < chains[0]->feature_estimates.size(); ++i) {
+
+        // The observations, and so the parent time step, are the same in every chain
+        const feature_estimate& f = chains[0]->feature_estimates[i];
+        const auto middle = f.observations().upper_bound (t);
+
+        if (t < f.parent_timestep) {
+            if (middle == f.observations().begin()) continue;
+            for (std::size_t c = 0; c < n; ++c) {
+                const auto& estimates = chains[c]->state_estimates;
+                const feature_type& estimate = chains[c]->feature_estimates[i].estimate;
+                new_obs[c] = proposed[c] + estimates.accumulate (t+1, f.parent_timestep) + estimate;
+                old_obs[c] = estimates.accumulate (t, f.parent_timestep) + estimate;
+            }
+            lockstep_obs_ratios (chains, n, t, {f.observations().begin(), middle}, new_obs, old_obs, log_ratio);
+        }
+        else {
+            if (middle == f.observations().end()) continue;
+            for (std::size_t c = 0; c < n; ++c) {
+                const auto& estimates = chains[c]->state_estimates;
+                const feature_type& estimate = chains[c]->feature_estimates[i].estimate;
+                new_obs[c] = -proposed[c] + estimates.accumulate (t, f.parent_timestep) + estimate;
+                old_obs[c] = estimates.accumulate (t+1, f.parent_timestep) + estimate;
+            }
+            lockstep_obs_ratios (chains, n, t+1, {middle, f.observations().end()}, new_obs, old_obs, log_ratio);
+        }
+    }
+
+    std::size_t accepted = 0;
+    for (std::size_t c = 0; c < n; ++c) {
+        mcmc_slam& chain = *chains[c];
+        state_edge edge (chain, t);
+        assert (std::isfinite (log_ratio[c]));
+        SLAM_COUNT (exact_evaluations);
+        const bool accept = log_ratio[c] > threshold[c];
+        count_update (edge, accept);
+        if (accept) {
+            edge.estimate = proposed[c];
+            edge.weight = std::exp (new_log_weight[c]);
+            chain.log_likelihood += log_ratio[c];
+            chain.map_estimate.clear();
+            chain.edge_changed (edge);
+            ++accepted;
+        }
+    }
+    return accepted;
+}
+
+
+template <class ControlModel, class ObservationModel>
+auto slam::mcmc_slam<ControlModel, ObservationModel>
+::update_feature_lockstep (mcmc_slam* const chains[], std::size_t n, std::size_t index) -> std::size_t {
+
+    const feature_estimate& f = chains[0]->feature_estimates[index];
+    const auto& proposal = f.observations().at (f.parent_timestep).proposal();
+
+    feature_type proposed[max_lockstep], old_obs[max_lockstep];
+    double threshold[max_lockstep], new_log_weight[max_lockstep], log_ratio[max_lockstep];
+
+    for (std::size_t c = 0; c < n; ++c) {
+        mcmc_slam& chain = *chains[c];
+        const feature_estimate& fc = chain.feature_estimates[index];
+        proposed[c] = proposal (chain.random);
+        const double new_proposal_log_likelihood = proposal.log_likelihood (proposed[c]);
+        threshold[c] = std::log (chain.random.uniform()) + new_proposal_log_likelihood - proposal.log_likelihood (fc.estimate);
+        new_log_weight[c] = edge_log_weight (new_proposal_log_likelihood, proposal.vector_dim);
+        old_obs[c] = fc.estimate;
+        log_ratio[c] = 0;
+    }
+
+    feature_type new_obs[max_lockstep];
+    std::copy (proposed, proposed + n, new_obs);
+    lockstep_obs_ratios (chains, n, f.parent_timestep, f.observations(), new_obs, old_obs, log_ratio);
+
+    std::size_t accepted = 0;
+    for (std::size_t c = 0; c < n; ++c) {
+        mcmc_slam& chain = *chains[c];
+        feature_edge edge (chain, index);
+        assert (std::isfinite (log_ratio[c]));
+        SLAM_COUNT (exact_evaluations);
+        const bool accept = log_ratio[c] > threshold[c];
+        count_update (edge, accept);
+        if (accept) {
+            edge.estimate = proposed[c];
+            edge.weight = std::exp (new_log_weight[c]);
+            chain.log_likelihood += log_ratio[c];
+            chain.map_estimate.clear();
+            ++accepted;
+        }
+    }
+    return accepted;
+}
+
+
 /** Computes the log probability of all the edges whose labels change when the action edge given by
  action_id is updated. Changing an action splits the spanning tree of the inference graph into
  two subtrees, T1 and T2. T1 is the tree that contains action 0. A feature vertex lies in T1 if
@@ -412,13 +1438,19 @@ auto slam::mcmc_slam<ControlModel, ObservationModel>
  if a feature vertex lies in T2 then the observations made before the change are affected. */
 template <class ControlModel, class ObservationModel>
 auto slam::mcmc_slam<ControlModel, ObservationModel>
-::edge_log_likelihood_ratio (const state_edge& edge, const state_type& proposed) const -> double {
+::edge_log_likelihood_ratio (const state_edge& edge, const state_type& proposed,
+                             std::size_t stride, std::size_t offset) const -> double {
 
-    double log_ratio =
+    const double control_log_ratio =
     + edge.distribution.log_likelihood (ControlModel::observe (proposed))
     - edge.distribution.log_likelihood (ControlModel::observe (edge.estimate));
+    SLAM_COUNT_N (likelihood_terms, 2);
+
+    double log_ratio = 0;
 
-    for (const auto& f : feature_estimates) { // iterate over all observed features.
+    for (std::size_t i = offset; i < feature_estimates.size(); i += stride) { // iterate over observed features.
+
+        const feature_estimate& f = feature_estimates[i];
 
         auto middle = f.observations().upper_bound (edge.timestep);
 
@@ -437,31 +1469,35 @@ auto slam::mcmc_slam<ControlModel, ObservationModel>
         }
     }
 
-    return log_ratio;
+    return control_log_ratio + stride * log_ratio;
 }
 
 
 template <class ControlModel, class ObservationModel>
 auto slam::mcmc_slam<ControlModel, ObservationModel>
-::edge_log_likelihood_ratio (const feature_edge& edge, const feature_type& proposed) const -> double {
+::edge_log_likelihood_ratio (const feature_edge& edge, const feature_type& proposed,
+                             std::size_t stride, std::size_t offset) const -> double {
 
     return obs_likelihood_ratio (edge.feature, edge.feature.parent_timestep,
-                                 edge.feature.observations(), proposed);
+                                 edge.feature.observations(), proposed, stride, offset);
 }
 
 
 template <class ControlModel, class ObservationModel>
 auto slam::mcmc_slam<ControlModel, ObservationModel>
 ::obs_likelihood_ratio (const feature_estimate& feature, timestep_type obs_timestep,
-                        feature_obs_range obs_range, feature_type new_obs) const -> double {
+                        feature_obs_range obs_range, feature_type new_obs,
+                        std::size_t stride, std::size_t offset) const -> double {
 
     double log_ratio = 0.0;
 
     feature_type old_obs = feature.estimate;
     old_obs = state_estimates.accumulate (obs_timestep, feature.parent_timestep) + old_obs;
 
-    for (const auto& obs : obs_range) {
+    const std::size_t size = obs_range.size();
+    for (std::size_t i = offset; i < size; i += stride) {
 
+        const auto& obs = obs_range[i];
         const state_type state_change = state_estimates.accumulate (obs.first, obs_timestep);
         new_obs = state_change + new_obs;
         old_obs = state_change + old_obs;
@@ -474,7 +1510,8 @@ auto slam::mcmc_slam<ControlModel, ObservationModel>
         log_ratio += new_log_likelihood - old_log_likelihood;
     }
 
-    return log_ratio;
+    SLAM_COUNT_N (likelihood_terms, 2 * (size > offset ? (size - offset + stride - 1) / stride : 0));
+    return stride * log_ratio;
 }
 
 
@@ -482,20 +1519,38 @@ template <class ControlModel, class ObservationModel>
 auto slam::mcmc_slam<ControlModel, ObservationModel>
 :: get_feature_map () const -> const feature_map_type& {
 
-    if (map_estimate.size() != feature_estimates.size()) {
+    if (map_estimate.size() != feature_estimates.size()) export_features_impl (map_estimate);
 
-        map_estimate.clear();
-        map_estimate.reserve (feature_estimates.size());
+    assert (map_estimate.size() == feature_estimates.size());
+    return map_estimate;
+}
 
-        for (const auto& id_index : feature_index) {
-            const feature_estimate& f = feature_estimates[id_index.second];
-            const feature_type obs = get_state(f.parent_timestep) + f.estimate;
-            map_estimate.emplace_hint (map_estimate.end(), id_index.first, obs);
-        }
+
+template <class ControlModel, class ObservationModel>
+void slam::mcmc_slam<ControlModel, ObservationModel>
+:: export_features_impl (feature_map_type& out) const {
+
+    // Every parent state is found in one pass, rather than accumulating the trajectory per feature
+    std::vector<state_type> states (current_timestep()+1);
+    state_estimates.accumulate_range (0, states.size(), states.begin());
+
+    out.clear();
+    out.reserve (feature_estimates.size());
+
+    for (const auto& id_index : feature_index) {
+        const feature_estimate& f = feature_estimates[id_index.second];
+        out.emplace_hint (out.end(), id_index.first, states[f.parent_timestep] + f.estimate);
     }
+}
 
-    assert (map_estimate.size() == feature_estimates.size());
-    return map_estimate;
+
+template <class ControlModel, class ObservationModel>
+void slam::mcmc_slam<ControlModel, ObservationModel>
+::publish_snapshot () {
+    SLAM_TRACE_SCOPE ("mcmc_slam::publish_snapshot");
+    snapshots->publish (std::unique_ptr<const snapshot> (new snapshot {
+        ++num_snapshots, current_timestep(), log_likelihood, slam_result_impl<state_type, feature_type> (*this)
+    }));
 }
 
 
@@ -507,7 +1562,41 @@ auto slam::mcmc_slam<ControlModel, ObservationModel>
     options.add_options()
     ("mcmc-slam-seed", po::value<unsigned int>(), "MCMC-SLAM random seed")
     ("mcmc-steps", po::value<unsigned int>()->default_value(0), "MCMC steps per time step")
-    ("mcmc-end-steps", po::value<unsigned int>()->default_value(0), "MCMC steps after simulation");
+    ("mcmc-end-steps", po::value<unsigned int>()->default_value(0), "MCMC steps after simulation")
+    ("mcmc-archive", po::value<std::string>(), "write thinned MCMC-SLAM samples to this archive file")
+    ("mcmc-archive-thin", po::value<unsigned int>()->default_value(100), "MCMC steps between archived samples")
+    ("mcmc-archive-key-interval", po::value<unsigned int>()->default_value(64),
+     "archived samples between full key samples")
+    ("mcmc-snapshot-interval", po::value<unsigned int>()->default_value(0),
+     "MCMC steps between estimate snapshots for concurrent readers (0 for none)")
+    ("mcmc-delayed-acceptance", po::value<unsigned int>()->default_value(1),
+     "screen proposals with every n-th likelihood term before the exact test (1 to disable)")
+    ("mcmc-austerity-epsilon", po::value<double>()->default_value(0),
+     "error bound of each sequential test on subsampled landmark observations (0 for exact tests)")
+    ("mcmc-austerity-batch", po::value<unsigned int>()->default_value(50),
+     "landmark observations added to the sequential test at a time")
+    ("mcmc-ukf-proposal", po::value<double>()->default_value(0),
+     "probability of proposing state edges from an unscented filter conditioned on the observations at their end")
+    ("mcmc-ukf-alpha", po::value<double>()->default_value(0.002), "alpha parameter of the unscented filter proposal")
+    ("mcmc-ukf-beta", po::value<double>()->default_value(2), "beta parameter of the unscented filter proposal")
+    ("mcmc-ukf-kappa", po::value<double>()->default_value(0), "kappa parameter of the unscented filter proposal")
+    ("mcmc-walk-weight", po::value<double>()->default_value(0),
+     "probability of proposing edges by an adaptive random walk from their current values")
+    ("mcmc-walk-burn-in", po::value<unsigned int>()->default_value(10000),
+     "updates during which the random walk steps adapt to accepted moves")
+    ("mcmc-schedule", po::value<std::string>()->default_value("random"),
+     "order of edge updates: random (by edge weight), sweep, random-sweep or blocked (features, then states)")
+    ("mcmc-reroot-interval", po::value<unsigned int>()->default_value(0),
+     "time steps between moves of feature parents to the median of their observations, or 0 for never")
+    ("mcmc-sweep-interval", po::value<unsigned int>()->default_value(0),
+     "updates between parallel sweeps over all landmarks with the trajectory fixed (0 to disable)")
+    ("mcmc-sweep-threads", po::value<unsigned int>()->default_value(0), "threads for landmark sweeps (0 for all)")
+    ("mcmc-speculative-steps", po::value<unsigned int>()->default_value(0),
+     "state edge updates per time step evaluated speculatively in parallel")
+    ("mcmc-speculative-end-steps", po::value<unsigned int>()->default_value(0),
+     "state edge updates evaluated speculatively in parallel after the simulation")
+    ("mcmc-speculative-threads", po::value<unsigned int>()->default_value(0),
+     "threads for speculative state edge updates (0 for all)");
     return options;
 }
 
@@ -516,7 +1605,20 @@ template <class ControlModel, class ObservationModel>
 slam::mcmc_slam<ControlModel, ObservationModel>::updater
 ::updater (const decltype(instance)& instance, const boost::program_options::variables_map& options)
 : updater (instance, options["mcmc-steps"].as<unsigned int>(), options["mcmc-end-steps"].as<unsigned int>())
-{ }
+{
+    set_snapshot_interval (options["mcmc-snapshot-interval"].as<unsigned int>());
+    instance->set_delayed_acceptance (options["mcmc-delayed-acceptance"].as<unsigned int>());
+    instance->set_austerity (options["mcmc-austerity-epsilon"].as<double>(), options["mcmc-austerity-batch"].as<unsigned int>());
+    instance->set_ukf_proposal (options["mcmc-ukf-proposal"].as<double>(), options["mcmc-ukf-alpha"].as<double>(),
+                                options["mcmc-ukf-beta"].as<double>(), options["mcmc-ukf-kappa"].as<double>());
+    instance->set_reroot_interval (options["mcmc-reroot-interval"].as<unsigned int>());
+    instance->set_random_walk (options["mcmc-walk-weight"].as<double>(), options["mcmc-walk-burn-in"].as<unsigned int>());
+    instance->set_schedule (mcmc_slam::parse_schedule (options["mcmc-schedule"].as<std::string>()));
+    set_feature_sweep (options["mcmc-sweep-interval"].as<unsigned int>(), options["mcmc-sweep-threads"].as<unsigned int>());
+    set_speculative_steps (options["mcmc-speculative-steps"].as<unsigned int>(),
+                           options["mcmc-speculative-end-steps"].as<unsigned int>(),
+                           options["mcmc-speculative-threads"].as<unsigned int>());
+}
 
 
 extern template class slam::mcmc_slam<control_model_type, observation_model_type>;
@@ -15,6 +15,11 @@
 #include <utility>
 #include <limits>
 #include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <cstdlib>
+#include <cstdint>
+#include <string>
 
 #include <boost/program_options.hpp>
 #include <boost/range/adaptor/indirected.hpp>
@@ -22,9 +27,12 @@
 #include "slam/interfaces.hpp"
 #include "slam/mcmc_slam.hpp"
 #include "slam/average_slam_result.hpp"
+#include "slam/slam_result_impl.hpp"
 #include "utility/random.hpp"
+#include "utility/trace.hpp"
 #include "utility/bitree.hpp"
 #include "utility/flat_map.hpp"
+#include "utility/processes.hpp"
 #include "utility/utility.hpp"
 
 #include "main.hpp"
@@ -53,8 +61,34 @@ namespace slam {
         unsigned int num_updates = 0;
         unsigned int num_accepted = 0;
         
+        std::size_t revision = 0;
+        
         unsigned int mcmc_end_steps;
         
+        // Progress of the end steps is written here, in the output directory if there is one
+        std::string report_file;
+        
+        // If greater than one, chains are updated in groups of this many with update_lockstep,
+        // which chooses edges by its own random scan rather than the chains' schedules
+        unsigned int lockstep;
+        random_source lockstep_random;
+        
+        // If greater than one, the end steps are run in this many forked processes, each with a
+        // share of the chains. Every chain's estimate is copied back into process_results, and the
+        // chains left in this process are stale, so they must not be updated again.
+        unsigned int num_processes;
+        std::vector<std::unique_ptr<slam_result_impl<state_type, feature_type>>> process_results;
+        const slam_result_type* best_process_result = nullptr;
+        double best_process_log_likelihood;
+        
+        static const unsigned int report_every = 100;
+        
+        void complete_in_processes (std::ostream& report);
+        
+        auto best () const -> const slam_result_type& {
+            return best_process_result ? *best_process_result : *max_likelihood;
+        }
+        
     public:
         
         multi_mcmc (std::shared_ptr<const slam_data_type>, boost::program_options::variables_map& options, unsigned int seed);
@@ -68,10 +102,12 @@ namespace slam {
         void update (unsigned int count);
         
         auto get_log_likelihood () const -> double {
-            return max_likelihood->get_log_likelihood();
+            return best_process_result ? best_process_log_likelihood : max_likelihood->get_log_likelihood();
         }
         
+        /** The average of the chains, including those run in worker processes */
         auto get_average () -> std::unique_ptr<slam_result_type> {
+            if (!process_results.empty()) return average_slam_result<state_type, feature_type> (process_results);
             return average_slam_result<state_type, feature_type> (mcmc_chains);
         }
         
@@ -84,26 +120,40 @@ namespace slam {
         }
         
         virtual auto current_timestep () const -> timestep_type override {
-            return max_likelihood->current_timestep();
+            return best().current_timestep();
         }
         
         virtual auto get_state (timestep_type t) const -> state_type override {
-            return max_likelihood->get_state (t);
+            return best().get_state (t);
         }
         
         virtual auto get_feature (featureid_type id) const -> feature_type override {
-            return max_likelihood->get_feature (id);
+            return best().get_feature (id);
         }
         
         virtual auto get_trajectory () const -> const trajectory_type& override {
-            return max_likelihood->get_trajectory();
+            return best().get_trajectory();
         }
         
         virtual auto get_feature_map () const -> const feature_map_type& override {
-            return max_likelihood->get_feature_map();
+            return best().get_feature_map();
+        }
+        
+        virtual auto trajectory_revision () const -> std::size_t override {
+            return revision + best().trajectory_revision();
         }
         
         virtual void completed () override;
+        
+    protected:
+        
+        virtual void export_states_impl (timestep_type first, timestep_type last, state_type* out) const override {
+            best().export_states (first, last, out);
+        }
+        
+        virtual void export_features_impl (feature_map_type& out) const override {
+            best().export_features (out);
+        }
     
     };
     
@@ -113,7 +163,30 @@ namespace slam {
 template <class ControlModel, class ObservationModel>
 void slam::multi_mcmc<ControlModel, ObservationModel>
 ::update (unsigned int count) {
+    SLAM_TRACE_SCOPE ("multi_mcmc::update", "steps", count);
+    if (!process_results.empty()) {
+        std::cerr << "Multi-MCMC chains cannot be updated after their end steps ran in worker processes\n";
+        std::exit (EXIT_FAILURE);
+    }
     using namespace boost::adaptors;
+    if (lockstep > 1) {
+        for (std::size_t first = 0; first < mcmc_chains.size(); first += lockstep) {
+            mcmc_slam_type* group[mcmc_slam_type::max_lockstep];
+            const std::size_t n = std::min<std::size_t> (lockstep, mcmc_chains.size() - first);
+            for (std::size_t c = 0; c < n; ++c) group[c] = mcmc_chains[first + c].get();
+            for (unsigned int i = 0; i < count; ++i) {
+                num_accepted += mcmc_slam_type::update_lockstep (group, n, lockstep_random);
+                num_updates += n;
+            }
+        }
+        for (auto& mcmc : indirect(mcmc_chains)) {
+            if (mcmc.get_log_likelihood() > max_likelihood->get_log_likelihood()) {
+                revision += max_likelihood->trajectory_revision() + 1;
+                max_likelihood = &mcmc;
+            }
+        }
+        return;
+    }
     for (auto& mcmc : indirect(mcmc_chains)) {
         for (unsigned int i = 0; i < count; ++i) {
             bool accepted = mcmc.update();
@@ -121,6 +194,7 @@ void slam::multi_mcmc<ControlModel, ObservationModel>
             ++num_updates;
         }
         if (mcmc.get_log_likelihood() > max_likelihood->get_log_likelihood()) {
+            revision += max_likelihood->trajectory_revision() + 1;
             max_likelihood = &mcmc;
         }
     }
@@ -130,9 +204,12 @@ void slam::multi_mcmc<ControlModel, ObservationModel>
 template <class ControlModel, class ObservationModel>
 void slam::multi_mcmc<ControlModel, ObservationModel>
 ::completed () {
-    std::ofstream report ("multi-mcmc-report.txt");
+    std::ofstream report (report_file);
+    if (num_processes > 1 && mcmc_chains.size() > 1 && mcmc_end_steps > 0) {
+        complete_in_processes (report);
+        return;
+    }
     unsigned int remaining_steps = mcmc_end_steps;
-    const unsigned int report_every = 100;
     while (remaining_steps > 0) {
         if (remaining_steps > report_every) {
             update (report_every);
@@ -150,6 +227,180 @@ void slam::multi_mcmc<ControlModel, ObservationModel>
 }
 
 
+/** Each process writes to its own part of a shared region: a header, the progress at each report
+ interval, and finally the estimate of each of its chains as vectors, with states relative to the
+ initial state. The parent reads them once the process has exited. */
+template <class ControlModel, class ObservationModel>
+void slam::multi_mcmc<ControlModel, ObservationModel>
+::complete_in_processes (std::ostream& report) {
+
+    struct header {
+        std::uint64_t finished;
+        std::uint64_t num_chains;
+        std::uint64_t best_chain;
+        double log_likelihood;
+    };
+    struct checkpoint {
+        std::uint64_t updates;
+        std::uint64_t accepted;
+        double log_likelihood;
+    };
+
+    const unsigned int processes = std::min<std::size_t> (num_processes, mcmc_chains.size());
+    const std::size_t max_chains = (mcmc_chains.size() + processes - 1) / processes;
+    const std::size_t num_checkpoints = (mcmc_end_steps + report_every - 1) / report_every;
+    const std::size_t num_states = max_likelihood->current_timestep();
+    const std::size_t num_features = max_likelihood->get_feature_map().size();
+
+    const std::size_t state_dim = state_type::vector_type::RowsAtCompileTime;
+    const std::size_t feature_dim = feature_type::vector_type::RowsAtCompileTime;
+
+    const std::size_t checkpoints_offset = sizeof (header);
+    const std::size_t estimates_offset = checkpoints_offset + num_checkpoints * sizeof (checkpoint);
+
+    // Offsets within each chain's estimate
+    const std::size_t ids_offset = (num_states+1) * state_dim * sizeof (double);
+    const std::size_t features_offset = ids_offset + num_features * sizeof (std::uint64_t);
+    const std::size_t estimate_size = features_offset + num_features * feature_dim * sizeof (double);
+
+    const std::size_t slot_size = estimates_offset + max_chains * estimate_size;
+
+    utility::shared_region channel (processes * slot_size);
+
+    const std::vector<bool> succeeded = utility::run_processes (processes, [&](unsigned int process) {
+
+        char* const slot = channel.data() + process * slot_size;
+        header& head = *reinterpret_cast<header*> (slot);
+        checkpoint* const checkpoints = reinterpret_cast<checkpoint*> (slot + checkpoints_offset);
+
+        // This process keeps every processes-th chain
+        decltype(mcmc_chains) chains;
+        for (std::size_t i = process; i < mcmc_chains.size(); i += processes) {
+            chains.push_back (std::move (mcmc_chains[i]));
+        }
+        mcmc_chains.swap (chains);
+        max_likelihood = mcmc_chains.front().get();
+        num_updates = num_accepted = 0;
+
+        unsigned int remaining_steps = mcmc_end_steps;
+        for (std::size_t c = 0; c < num_checkpoints; ++c) {
+            const unsigned int steps = remaining_steps < report_every ? remaining_steps : report_every;
+            update (steps);
+            remaining_steps -= steps;
+            checkpoints[c] = { num_updates, num_accepted, get_log_likelihood() };
+        }
+
+        std::vector<state_type> states (num_states+1);
+        std::size_t best_chain = 0;
+
+        for (std::size_t i = 0; i < mcmc_chains.size(); ++i) {
+
+            const mcmc_slam_type& chain = *mcmc_chains[i];
+            if (&chain == max_likelihood) best_chain = i;
+            char* const estimate = slot + estimates_offset + i * estimate_size;
+
+            const state_type initial_state = chain.get_initial_state();
+            chain.export_states (timestep_type (0), timestep_type (num_states+1), states.data());
+
+            double* state_out = reinterpret_cast<double*> (estimate);
+            for (std::size_t t = 0; t <= num_states; ++t, state_out += state_dim) {
+                const auto v = (t == 0 ? initial_state : -initial_state + states[t]).to_vector();
+                std::copy (v.data(), v.data() + state_dim, state_out);
+            }
+
+            const auto& map = chain.get_feature_map();
+            if (map.size() != num_features) return EXIT_FAILURE;
+            std::uint64_t* id_out = reinterpret_cast<std::uint64_t*> (estimate + ids_offset);
+            double* feature_out = reinterpret_cast<double*> (estimate + features_offset);
+            for (const auto& f : map) {
+                *id_out++ = std::size_t (f.first);
+                const auto v = f.second.to_vector();
+                feature_out = std::copy (v.data(), v.data() + feature_dim, feature_out);
+            }
+        }
+
+        head.num_chains = mcmc_chains.size();
+        head.best_chain = best_chain;
+        head.log_likelihood = get_log_likelihood();
+        head.finished = 1;
+        return EXIT_SUCCESS;
+    });
+
+    std::size_t chains_reported = 0;
+    std::vector<const char*> slots;
+
+    for (unsigned int process = 0; process < processes; ++process) {
+
+        const char* const slot = channel.data() + process * slot_size;
+        const header& head = *reinterpret_cast<const header*> (slot);
+        if (!succeeded[process] || !head.finished) {
+            std::cerr << "Multi-MCMC worker process " << process << " failed; its chains are left out\n";
+            continue;
+        }
+        slots.push_back (slot);
+        chains_reported += head.num_chains;
+
+        for (std::size_t c = 0; c < head.num_chains; ++c) {
+
+            const char* const estimate = slot + estimates_offset + c * estimate_size;
+
+            auto result = utility::make_unique<slam_result_impl<state_type, feature_type>>();
+            const double* state_in = reinterpret_cast<const double*> (estimate);
+            typename state_type::vector_type v;
+            std::copy (state_in, state_in + state_dim, v.data());
+            result->set_initial_state (state_type::from_vector (v));
+            auto& trajectory = result->get_trajectory();
+            trajectory.reserve (num_states);
+            for (std::size_t t = 1; t <= num_states; ++t) {
+                std::copy (state_in + t*state_dim, state_in + (t+1)*state_dim, v.data());
+                trajectory.push_back_accumulated (state_type::from_vector (v));
+            }
+
+            const std::uint64_t* id_in = reinterpret_cast<const std::uint64_t*> (estimate + ids_offset);
+            const double* feature_in = reinterpret_cast<const double*> (estimate + features_offset);
+            auto& map = result->get_feature_map();
+            map.reserve (num_features);
+            for (std::size_t i = 0; i < num_features; ++i) {
+                typename feature_type::vector_type f;
+                std::copy (feature_in + i*feature_dim, feature_in + (i+1)*feature_dim, f.data());
+                map.emplace_hint (map.end(), featureid_type (id_in[i]), feature_type::from_vector (f));
+            }
+
+            if (c == head.best_chain && (!best_process_result || head.log_likelihood > best_process_log_likelihood)) {
+                best_process_result = result.get();
+                best_process_log_likelihood = head.log_likelihood;
+            }
+            process_results.push_back (std::move (result));
+        }
+    }
+
+    if (slots.empty()) {
+        std::cerr << "Every Multi-MCMC worker process failed; the estimate is from before the end steps\n";
+        return;
+    }
+    ++revision;
+
+    for (std::size_t c = 0; c < num_checkpoints; ++c) {
+        std::uint64_t updates = 0, accepted = 0;
+        double log_likelihood = -std::numeric_limits<double>::infinity();
+        for (const char* slot : slots) {
+            const checkpoint& point = reinterpret_cast<const checkpoint*> (slot + checkpoints_offset)[c];
+            updates += point.updates;
+            accepted += point.accepted;
+            log_likelihood = std::max (log_likelihood, point.log_likelihood);
+        }
+        report
+        << ((double)updates / chains_reported) << '\t'
+        << ((double)accepted / chains_reported) << '\t'
+        << log_likelihood << '\n';
+        if (c+1 == num_checkpoints) {
+            num_updates += updates;
+            num_accepted += accepted;
+        }
+    }
+}
+
+
 template <class ControlModel, class ObservationModel>
 auto slam::multi_mcmc<ControlModel, ObservationModel>
 ::program_options () -> boost::program_options::options_description {
@@ -157,7 +408,11 @@ auto slam::multi_mcmc<ControlModel, ObservationModel>
     po::options_description options ("Multi-MCMC Parameters");
     options.add_options()
     ("multi-mcmc-chains", po::value<unsigned int>()->default_value(100), "Number of MCMC chains")
-    ("multi-mcmc-end-steps", po::value<unsigned int>()->default_value(0), "MCMC iterations after simulation");
+    ("multi-mcmc-end-steps", po::value<unsigned int>()->default_value(0), "MCMC iterations after simulation")
+    ("multi-mcmc-lockstep", po::value<unsigned int>()->default_value(1),
+     "update chains in groups of this many (up to 8), sharing the edge chosen and the likelihood pass")
+    ("multi-mcmc-processes", po::value<unsigned int>()->default_value(1),
+     "run the end steps in this many worker processes, each with a share of the chains");
     return options;
 }
 
@@ -166,17 +421,39 @@ template <class ControlModel, class ObservationModel>
 slam::multi_mcmc<ControlModel, ObservationModel>
 ::multi_mcmc (std::shared_ptr<const slam_data<ControlModel, ObservationModel>> data,
               boost::program_options::variables_map& options, unsigned int seed)
-: mcmc_end_steps (options["multi-mcmc-end-steps"].as<unsigned int>())
+: mcmc_end_steps (options["multi-mcmc-end-steps"].as<unsigned int>()),
+lockstep (options["multi-mcmc-lockstep"].as<unsigned int>()),
+num_processes (options["multi-mcmc-processes"].as<unsigned int>())
 {
+    report_file = options.count ("output-dir")
+    ? options["output-dir"].as<std::string>() + "/multi-mcmc-report.txt"
+    : std::string ("multi-mcmc-report.txt");
+
+    if (lockstep > mcmc_slam_type::max_lockstep) {
+        std::cerr << "multi-mcmc-lockstep must be at most " << mcmc_slam_type::max_lockstep << '\n';
+        std::exit (EXIT_FAILURE);
+    }
 
     random_source random (seed);
     
     unsigned int num_mcmc_chains = options["multi-mcmc-chains"].as<unsigned int>();
     while (num_mcmc_chains--) {
         mcmc_chains.push_back (utility::make_unique<mcmc_slam_type> (data, random()));
+        mcmc_chains.back()->set_delayed_acceptance (options["mcmc-delayed-acceptance"].as<unsigned int>());
+        mcmc_chains.back()->set_austerity (options["mcmc-austerity-epsilon"].as<double>(),
+                                           options["mcmc-austerity-batch"].as<unsigned int>());
+        mcmc_chains.back()->set_ukf_proposal (options["mcmc-ukf-proposal"].as<double>(),
+                                              options["mcmc-ukf-alpha"].as<double>(),
+                                              options["mcmc-ukf-beta"].as<double>(),
+                                              options["mcmc-ukf-kappa"].as<double>());
+        mcmc_chains.back()->set_reroot_interval (options["mcmc-reroot-interval"].as<unsigned int>());
+        mcmc_chains.back()->set_random_walk (options["mcmc-walk-weight"].as<double>(),
+                                             options["mcmc-walk-burn-in"].as<unsigned int>());
+        mcmc_chains.back()->set_schedule (mcmc_slam_type::parse_schedule (options["mcmc-schedule"].as<std::string>()));
     }
     
     max_likelihood = mcmc_chains.front().get();
+    lockstep_random.seed (random());
 }
 
 
@@ -0,0 +1,217 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+
+#include "slam/scheduler.hpp"
+#include "utility/trace.hpp"
+
+
+namespace {
+
+    // Weight of the latest quantum in the averaged speed and gain of a task
+    const double smoothing = 0.25;
+
+    double milliseconds (slam::scheduler::clock::duration d) {
+        return std::chrono::duration<double, std::milli> (d).count();
+    }
+
+    auto duration (double ms) -> slam::scheduler::clock::duration {
+        return std::chrono::duration_cast<slam::scheduler::clock::duration> (std::chrono::duration<double, std::milli> (ms));
+    }
+
+}
+
+
+slam::scheduler::task_state::task_state (const task& t)
+: t(t), gain_rate (std::numeric_limits<double>::quiet_NaN())
+{ }
+
+
+slam::scheduler::scheduler (double budget_ms, double end_budget_ms, double quantum_ms, unsigned int cores)
+: budget_ms(budget_ms), end_budget_ms(end_budget_ms), quantum_ms(quantum_ms)
+{
+    if (cores == 0) cores = std::max (std::thread::hardware_concurrency(), 1u);
+    for (unsigned int i = 1; i < cores; ++i) workers.emplace_back (&scheduler::worker_loop, this);
+}
+
+
+slam::scheduler::scheduler (const boost::program_options::variables_map& options)
+: scheduler (options["scheduler-budget"].as<double>(), options["scheduler-end-budget"].as<double>(),
+             options["scheduler-quantum"].as<double>(), options["scheduler-cores"].as<unsigned int>())
+{ }
+
+
+slam::scheduler::~scheduler () {
+    {
+        std::lock_guard<std::mutex> lock (mutex);
+        stopping = true;
+    }
+    round_started.notify_all();
+    for (auto& w : workers) w.join();
+}
+
+
+void slam::scheduler::add_task (const task& t) {
+    assert (t.work && t.objective);
+    std::lock_guard<std::mutex> lock (mutex);
+    tasks.emplace_back (t);
+}
+
+
+void slam::scheduler::timestep (timestep_type t) {
+    const auto start = clock::now();
+    for (auto& s : tasks) if (s.t.timestep) s.t.timestep (t);
+    run_round (start + duration (budget_ms));
+}
+
+
+void slam::scheduler::completed () {
+    const auto start = clock::now();
+    for (auto& s : tasks) if (s.t.completed) s.t.completed();
+    run_round (start + duration (end_budget_ms));
+}
+
+
+void slam::scheduler::run_round (clock::time_point round_deadline) {
+    if (tasks.empty() || !(clock::now() < round_deadline)) return;
+    {
+        std::lock_guard<std::mutex> lock (mutex);
+        deadline = round_deadline;
+        for (auto& s : tasks) s.idle = false;
+        workers_busy = unsigned (workers.size());
+        ++round;
+    }
+    round_started.notify_all();
+    while (run_quantum()) { }
+    std::unique_lock<std::mutex> lock (mutex);
+    round_finished.wait (lock, [this]{ return workers_busy == 0; });
+}
+
+
+auto slam::scheduler::pick_task () -> task_state* {
+    task_state* best = nullptr;
+    double best_score = 0;
+    for (auto& s : tasks) {
+        if (s.running || s.idle) continue;
+        const double score = std::isnan (s.gain_rate)
+        ? std::numeric_limits<double>::infinity()
+        : s.t.priority * std::max (s.gain_rate, 0.0);
+        // Equal scores, such as when nothing is improving, share time in proportion to priority
+        if (!best || score > best_score
+            || (score == best_score && s.total_ms * best->t.priority < best->total_ms * s.t.priority)) {
+            best = &s;
+            best_score = score;
+        }
+    }
+    return best;
+}
+
+
+bool slam::scheduler::run_quantum () {
+
+    std::unique_lock<std::mutex> lock (mutex);
+
+    const auto start = clock::now();
+    if (!(start < deadline)) return false;
+
+    task_state* const s = pick_task();
+    if (!s) return false;
+    s->running = true;
+
+    // Size the quantum from measured speed, so that it ends near quantum_ms or the deadline
+    const double target_ms = std::min (quantum_ms, milliseconds (deadline - start));
+    const double target_units = s->units_per_ms * target_ms;
+    const unsigned int units = target_units < 1 ? 1
+    : unsigned (std::min<double> (target_units, std::numeric_limits<unsigned int>::max()));
+
+    lock.unlock();
+
+    const double before = s->t.objective();
+    unsigned int done;
+    {
+        SLAM_TRACE_SCOPE (s->t.name, "units", units);
+        done = s->t.work (units);
+    }
+    const double elapsed_ms = milliseconds (clock::now() - start);
+    const double after = s->t.objective();
+
+    lock.lock();
+
+    s->running = false;
+    ++s->quanta;
+    s->units += done;
+    s->total_ms += elapsed_ms;
+
+    if (done == 0) {
+        s->idle = true;
+        return true;
+    }
+    if (elapsed_ms > 0) {
+        const double speed = done / elapsed_ms;
+        s->units_per_ms = s->units_per_ms > 0 ? s->units_per_ms + smoothing * (speed - s->units_per_ms) : speed;
+        if (std::isfinite (before) && std::isfinite (after)) {
+            const double gain = (after - before) / elapsed_ms;
+            s->gain_rate = std::isnan (s->gain_rate) ? gain : s->gain_rate + smoothing * (gain - s->gain_rate);
+            s->total_gain += after - before;
+        }
+    }
+    return true;
+}
+
+
+void slam::scheduler::worker_loop () {
+    SLAM_TRACE_THREAD ("scheduler worker");
+    unsigned long last_round = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock (mutex);
+            round_started.wait (lock, [&]{ return stopping || round != last_round; });
+            if (stopping) return;
+            last_round = round;
+        }
+        while (run_quantum()) { }
+        {
+            std::lock_guard<std::mutex> lock (mutex);
+            --workers_busy;
+        }
+        round_finished.notify_all();
+    }
+}
+
+
+void slam::scheduler::report (std::ostream& out) const {
+    std::lock_guard<std::mutex> lock (mutex);
+    out << "Scheduler (" << workers.size()+1 << " cores, " << budget_ms << " ms per time step)\n"
+    << std::left << std::setw (20) << "task" << std::right
+    << std::setw (12) << "quanta" << std::setw (14) << "units" << std::setw (12) << "time (ms)"
+    << std::setw (14) << "gain" << std::setw (12) << "gain/ms" << '\n';
+    for (const auto& s : tasks) {
+        out << std::left << std::setw (20) << s.t.name << std::right
+        << std::setw (12) << s.quanta << std::setw (14) << s.units
+        << std::setw (12) << std::fixed << std::setprecision (1) << s.total_ms
+        << std::setw (14) << std::setprecision (3) << s.total_gain
+        << std::setw (12) << (s.total_ms > 0 ? s.total_gain / s.total_ms : 0.0) << '\n';
+        out.unsetf (std::ios::floatfield);
+    }
+    out << std::setprecision (6) << '\n';
+}
+
+
+auto slam::scheduler::program_options () -> boost::program_options::options_description {
+    namespace po = boost::program_options;
+    po::options_description options ("Scheduler Parameters");
+    options.add_options()
+    ("scheduler-budget", po::value<double>(),
+     "milliseconds per time step to share between estimators, in place of their steps per time step")
+    ("scheduler-end-budget", po::value<double>()->default_value(0),
+     "milliseconds to share between estimators after the simulation")
+    ("scheduler-quantum", po::value<double>()->default_value(2), "target milliseconds of each quantum of work")
+    ("scheduler-cores", po::value<unsigned int>()->default_value(0), "cores to schedule on (0 for all)")
+    ("scheduler-mcmc-priority", po::value<double>()->default_value(1), "priority of MCMC-SLAM")
+    ("scheduler-multi-mcmc-priority", po::value<double>()->default_value(1), "priority of Multi-MCMC-SLAM")
+    ("scheduler-g2o-priority", po::value<double>()->default_value(1), "priority of G2O-SLAM");
+    return options;
+}
@@ -0,0 +1,119 @@
+#ifndef _SLAM_SCHEDULER_HPP
+#define _SLAM_SCHEDULER_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <iosfwd>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <boost/program_options.hpp>
+
+#include "slam/interfaces.hpp"
+
+
+namespace slam {
+
+
+    /** Shares a time budget for each time step between several estimators, in place of their fixed
+     steps per time step. After bringing every estimator up to the new time step, the scheduler
+     hands out quanta of work to a pool of cores until the budget is spent. An idle core takes the
+     estimator, not already running, with the largest priority times measured objective gain per
+     millisecond; estimators that have not been measured yet go first, and ties share time in
+     proportion to priority. Each quantum is sized from the estimator's measured speed to last
+     about the configured quantum time, and is cut short near the deadline. Estimators run
+     concurrently with each other but never with themselves. */
+    class scheduler : public timestep_listener {
+
+    public:
+
+        using clock = std::chrono::steady_clock;
+
+        struct task {
+
+            /** Must be a string literal; used in traces and the report */
+            const char* name;
+
+            double priority;
+
+            /** Brings the estimator up to date, before any quanta in that time step */
+            std::function<void(timestep_type)> timestep;
+            std::function<void()> completed;
+
+            /** Does up to the given number of units of work, returning the number done. Returning
+             zero means the estimator has no work left until the next time step. */
+            std::function<unsigned int(unsigned int)> work;
+
+            /** Higher is better, such as a log likelihood. Values that are not finite are ignored. */
+            std::function<double()> objective;
+        };
+
+    private:
+
+        struct task_state {
+            task t;
+            bool running = false;
+            bool idle = false;
+
+            // Exponentially weighted averages over quanta; gain_rate is NaN until measured
+            double units_per_ms = 0;
+            double gain_rate;
+
+            unsigned long quanta = 0;
+            unsigned long units = 0;
+            double total_ms = 0;
+            double total_gain = 0;
+
+            explicit task_state (const task&);
+        };
+
+        std::vector<task_state> tasks;
+
+        double budget_ms, end_budget_ms, quantum_ms;
+
+        mutable std::mutex mutex;
+        std::condition_variable round_started, round_finished;
+        clock::time_point deadline;
+        unsigned long round = 0;
+        unsigned int workers_busy = 0;
+        bool stopping = false;
+
+        std::vector<std::thread> workers;
+
+        /** Runs quanta on this thread and every worker until the deadline or until no task has work */
+        void run_round (clock::time_point deadline);
+
+        /** Runs one quantum; returns false if none could be started */
+        bool run_quantum ();
+
+        auto pick_task () -> task_state*;
+
+        void worker_loop ();
+
+    public:
+
+        scheduler (double budget_ms, double end_budget_ms, double quantum_ms, unsigned int cores);
+        explicit scheduler (const boost::program_options::variables_map&);
+        ~scheduler ();
+
+        scheduler (const scheduler&) = delete;
+        scheduler& operator= (const scheduler&) = delete;
+
+        /** Tasks must all be added before the first time step */
+        void add_task (const task&);
+
+        virtual void timestep (timestep_type) override;
+        virtual void completed () override;
+
+        /** Quanta, units of work, CPU time and objective gain of each task */
+        void report (std::ostream&) const;
+
+        static boost::program_options::options_description program_options ();
+    };
+
+
+}
+
+#endif
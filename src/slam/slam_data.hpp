@@ -12,8 +12,11 @@
 #include <boost/range/adaptor/map.hpp>
 
 #include "slam/interfaces.hpp"
+#include "slam/latency_stats.hpp"
 #include "utility/flat_map.hpp"
 #include "utility/listeners.hpp"
+#include "utility/memory.hpp"
+#include "utility/trace.hpp"
 #include "utility/utility.hpp"
 
 #include "main.hpp"
@@ -29,11 +32,15 @@ namespace slam {
     template <class ControlModel, class ObservationModel>
     class slam_data : public data_source {
         
+        template <class T> using allocator = utility::tracked_allocator<T, utility::memory::slam_data>;
+
     public:
-        using feature_observations = utility::flat_map<timestep_type, ObservationModel>;
+        using feature_observations = utility::flat_map<timestep_type, ObservationModel, std::less<timestep_type>,
+                                                       allocator<std::pair<timestep_type, ObservationModel>>>;
 
     private:
-        using feature_collection = std::map<featureid_type, feature_observations>;
+        using feature_collection = std::map<featureid_type, feature_observations, std::less<featureid_type>,
+                                            allocator<std::pair<const featureid_type, feature_observations>>>;
         
     public:
         using feature_iterator = typename feature_collection::const_iterator;
@@ -61,16 +68,23 @@ namespace slam {
         
     private:
 
-        using observation_collection = utility::flat_multimap<timestep_type, observation_info>;
+        using observation_collection = utility::flat_multimap<timestep_type, observation_info, std::less<timestep_type>,
+                                                              allocator<std::pair<timestep_type, observation_info>>>;
         using observation_range = boost::sub_range<const observation_collection>;
 
         feature_collection m_features;
         observation_collection m_observations;
         
-        std::vector<ControlModel> m_controls;
+        std::vector<ControlModel, allocator<ControlModel>> m_controls;
         utility::listeners<timestep_listener> m_timestep_listeners;
         utility::listeners<listener> m_listeners;
         
+        std::shared_ptr<latency_stats> m_latency;
+        
+        /** Invokes f on each listener, recording latencies if latency_stats have been set */
+        template <class Listener, class Functor>
+        void dispatch (latency_stats::event, const utility::listeners<Listener>&, Functor f) const;
+        
     public:
         
         slam_data () { }
@@ -89,11 +103,14 @@ namespace slam {
         
         virtual void timestep (timestep_type timestep) override {
             assert (timestep == current_timestep());
+            SLAM_TRACE_SCOPE ("slam_data::timestep", "timestep", timestep);
             using namespace std::placeholders;
-            m_timestep_listeners.for_each (std::bind (&listener::timestep, _1, timestep));
+            dispatch (latency_stats::timestep, m_timestep_listeners, std::bind (&listener::timestep, _1, timestep));
+            if (m_latency) m_latency->timestep_completed (timestep);
         }
         
         virtual void completed () override {
+            SLAM_TRACE_SCOPE ("slam_data::completed");
             using namespace std::placeholders;
             m_timestep_listeners.for_each (std::bind (&listener::completed, _1));
         }
@@ -146,6 +163,12 @@ namespace slam {
             m_listeners.add(l);
         }
         
+        /** Record the latency of every dispatch to the listeners */
+        
+        void set_latency_stats (const std::shared_ptr<latency_stats>& stats) {
+            m_latency = stats;
+        }
+        
     };
     
 } // namespace slam
@@ -159,7 +182,7 @@ void slam::slam_data<ControlModel, ObservationModel>
     m_controls.push_back (control);
 
     using namespace std::placeholders;
-    m_listeners.for_each (std::bind (&listener::control, _1, t, std::cref(control)));
+    dispatch (latency_stats::control, m_listeners, std::bind (&listener::control, _1, t, std::cref(control)));
 }
 
 
@@ -183,7 +206,28 @@ void slam::slam_data<ControlModel, ObservationModel>
                                                       observation_info (feature_iter, obs_index));
     
     using namespace std::placeholders;
-    m_listeners.for_each (std::bind (&listener::observation, _1, t, std::cref(obs_info_iter->second)));
+    dispatch (latency_stats::observation, m_listeners,
+              std::bind (&listener::observation, _1, t, std::cref(obs_info_iter->second)));
+}
+
+
+template <class ControlModel, class ObservationModel>
+template <class Listener, class Functor>
+void slam::slam_data<ControlModel, ObservationModel>
+::dispatch (latency_stats::event e, const utility::listeners<Listener>& listeners, Functor f) const {
+    
+    if (!m_latency) {
+        listeners.for_each (f);
+        return;
+    }
+    
+    const auto start = latency_stats::clock::now();
+    listeners.for_each ([&](Listener* l) {
+        const auto listener_start = latency_stats::clock::now();
+        f (l);
+        m_latency->record (e, typeid(*l), latency_stats::nanoseconds_since (listener_start));
+    });
+    m_latency->record (e, latency_stats::nanoseconds_since (start));
 }
 
 
@@ -194,6 +238,7 @@ void slam::slam_data<ControlModel, ObservationModel>
                const typename ObservationModel::builder& obs_model_builder) {
     
     using namespace boost::adaptors;
+    SLAM_TRACE_SCOPE ("slam_data::add_dataset");
 
     auto add_observations = [&](timestep_type t) {
         for (const auto& obs : values(data.observations_at(t))) {
@@ -15,6 +15,7 @@
 #include "slam/slam_data.hpp"
 #include "slam/slam_result_impl.hpp"
 #include "utility/random.hpp"
+#include "utility/trace.hpp"
 
 
 namespace slam {
@@ -37,12 +38,14 @@ namespace slam {
         virtual void control (timestep_type t, const ControlModel& control) override {
             (void)t; // Silence unused variable warning
             assert (t == this->current_timestep());
+            SLAM_TRACE_SCOPE ("slam_initialiser::control", "timestep", t);
             auto initial_estimate = control.proposal().initial_value (random);
-            this->get_trajectory().push_back (initial_estimate);
+            this->append_state (initial_estimate);
         }
         
         virtual void observation (timestep_type t, const typename slam_data_type::observation_info& obs) override {
             assert (t == this->current_timestep());
+            SLAM_TRACE_SCOPE ("slam_initialiser::observation", "timestep", t);
             if (obs.index() == 0) {
                 auto initial_estimate = obs.observation().proposal().initial_value (random);
                 this->get_feature_map()[obs.id()] = this->get_state(t) + initial_estimate;
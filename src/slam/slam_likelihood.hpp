@@ -9,6 +9,8 @@
 #ifndef slam_slam_likelihood_hpp
 #define slam_slam_likelihood_hpp
 
+#include <vector>
+
 #include "slam/interfaces.hpp"
 #include "slam/slam_data.hpp"
 
@@ -29,23 +31,21 @@ namespace slam {
         
         double log_likelihood = 0;
         
-        const auto& trajectory = estimate.get_trajectory();
-        for (timestep_type t; t < trajectory.size(); ++t) {
-            log_likelihood += data.control(t).log_likelihood (ControlModel::observe (trajectory[t]));
+        // States are exported in one pass, so each term below costs constant time
+        std::vector<typename ControlModel::associated_type> states (estimate.current_timestep()+1);
+        estimate.export_states (timestep_type(0), timestep_type(states.size()), states.data());
+        
+        for (timestep_type t; t+1 < states.size(); ++t) {
+            log_likelihood += data.control(t).log_likelihood (ControlModel::observe (-states[t] + states[t+1]));
         }
         
-        const auto initial_state = estimate.get_initial_state();
         for (const auto& id_feature : estimate.get_feature_map()) {
             
             const featureid_type id = id_feature.first;
             if (!data.feature_observed (id)) continue;
             
-            auto feature = -initial_state + id_feature.second;
-
-            timestep_type timestep {0};
             for (const auto& obs : data.get_observations(id)) {
-                feature = trajectory.accumulate (obs.first, timestep) + feature;
-                timestep = obs.first;
+                const auto feature = -states[obs.first] + id_feature.second;
                 const ObservationModel& distribution = obs.second;
                 log_likelihood += distribution.log_likelihood (ObservationModel::observe (feature));
             }
@@ -31,6 +31,7 @@ namespace slam {
         state_type m_initial_state;
         trajectory_type m_trajectory;
         feature_map_type m_map;
+        std::size_t m_revision = 0;
 
     public:
         
@@ -44,6 +45,7 @@ namespace slam {
             m_initial_state = o.get_initial_state();
             m_trajectory = o.get_trajectory();
             m_map = o.get_feature_map();
+            ++m_revision;
             return *this;
         }
         
@@ -82,13 +84,31 @@ namespace slam {
             return m_map;
         }
         
+        virtual auto trajectory_revision () const -> std::size_t override {
+            return m_revision;
+        }
+        
         /** Allow non-const reference to slam_result_impl */
         
         void set_initial_state (const state_type& state) {
             m_initial_state = state;
+            ++m_revision;
+        }
+        
+        /** Appends a state edge. Past states are unchanged, so the revision is too. */
+        void append_state (const state_type& edge) {
+            m_trajectory.push_back (edge);
+        }
+        
+        /** Appends the edge that ends at state, given relative to the initial state */
+        void append_accumulated_state (const state_type& state) {
+            m_trajectory.push_back_accumulated (state);
         }
         
+        /** Conservatively assumes that the caller modifies past states; use the append functions
+         to extend the trajectory without changing the revision. */
         auto get_trajectory () -> trajectory_type& {
+            ++m_revision;
             return m_trajectory;
         }
         
@@ -96,6 +116,17 @@ namespace slam {
             return m_map;
         }
         
+    protected:
+        
+        virtual void export_states_impl (timestep_type first, timestep_type last, state_type* out) const override {
+            const auto end = m_trajectory.accumulate_range (first, last, out);
+            for (; out != end; ++out) *out = m_initial_state + *out;
+        }
+        
+        virtual void export_features_impl (feature_map_type& out) const override {
+            out = m_map;
+        }
+        
     };
 
     
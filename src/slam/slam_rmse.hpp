@@ -11,6 +11,8 @@
 
 #include <cmath>
 #include <utility>
+#include <vector>
+#include <algorithm>
 
 #include <boost/accumulators/accumulators.hpp>
 #include <boost/accumulators/statistics/stats.hpp>
@@ -27,13 +29,15 @@ namespace slam {
         accumulator_set<double, stats<tag::mean>> acc;
         
         {
-            const auto& at = a.get_trajectory();
-            const auto& bt = b.get_trajectory();
-            auto t = std::min (at.size(), bt.size());
+            const timestep_type t = std::min (a.current_timestep(), b.current_timestep());
+            std::vector<State> as (t), bs (t);
+            a.export_states (timestep_type(1), t+1, as.data());
+            b.export_states (timestep_type(1), t+1, bs.data());
             
-            for (size_t i = 1; i <= t; ++i) {
-                acc (State::subtract(at.accumulate(i).to_vector(), bt.accumulate(i).to_vector())
-                     .squaredNorm());
+            for (size_t i = 0; i < t; ++i) {
+                const State at = -a.get_initial_state() + as[i];
+                const State bt = -b.get_initial_state() + bs[i];
+                acc (State::subtract(at.to_vector(), bt.to_vector()).squaredNorm());
             }
         }
 
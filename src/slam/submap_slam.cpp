@@ -0,0 +1,3 @@
+#include "slam/submap_slam.hpp"
+
+template class slam::submap_slam<control_model_type, observation_model_type>;
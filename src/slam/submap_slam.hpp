@@ -0,0 +1,319 @@
+#ifndef slam_submap_slam_hpp
+#define slam_submap_slam_hpp
+
+#include <cassert>
+#include <chrono>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <boost/program_options.hpp>
+
+#include "planar_robot/rms_error.hpp"
+#include "slam/interfaces.hpp"
+#include "slam/slam_data.hpp"
+#include "slam/slam_result_impl.hpp"
+#include "utility/random.hpp"
+#include "utility/trace.hpp"
+
+#include "main.hpp"
+
+
+namespace slam {
+
+
+    /** Cuts the data stream into submaps, each a run of consecutive time steps, and solves each
+     submap with its own estimator in a frame whose origin is the submap's first state. A submap
+     is closed once it spans submap-length time steps or the robot is submap-extent away from its
+     origin; the next one starts at the same time step, so neighbours share that state as well as
+     any landmarks seen by both. Closed submaps finish (run their estimator's end steps) on
+     separate threads. On completion the submaps are placed in a common frame by block coordinate
+     descent: each submap in turn is moved to the rigid transformation that best aligns its shared
+     landmarks and boundary states with its neighbours'. The global estimate concatenates the
+     aligned trajectories and averages the aligned landmarks, and is only available after the
+     data is completed. */
+
+    template <class ControlModel, class ObservationModel>
+    class submap_slam : public slam_result_of_impl<ControlModel, ObservationModel>,
+                        public slam_data<ControlModel, ObservationModel>::listener {
+
+        using slam_data_type = slam_data<ControlModel, ObservationModel>;
+        using slam_result_type = slam_result_of<ControlModel, ObservationModel>;
+
+        using state_type = typename slam_result_type::state_type;
+        using feature_type = typename slam_result_type::feature_type;
+        using feature_map_type = typename slam_result_type::feature_map_type;
+
+    public:
+
+        /** An estimator for one submap, together with the listeners it registered on the
+         submap's data, which only holds weak references to them. */
+        struct estimator {
+            std::shared_ptr<slam_result_type> result;
+            std::vector<std::shared_ptr<timestep_listener>> listeners;
+        };
+
+        /** Creates an estimator listening to the given submap data */
+        using estimator_factory = std::function<estimator(const std::shared_ptr<slam_data_type>&, unsigned int seed)>;
+
+    private:
+
+        struct submap {
+            timestep_type start;  // Global time step of the submap's origin
+            std::shared_ptr<slam_data_type> data;
+            estimator est;
+            std::future<void> finished;
+        };
+
+        const std::shared_ptr<const slam_data_type> global_data;
+        const estimator_factory make_estimator;
+        random_source random;
+
+        const unsigned int max_length;
+        const double max_extent;
+        const unsigned int align_iterations;
+        const unsigned int max_finishing;
+
+        std::vector<std::unique_ptr<submap>> submaps;
+
+        void open_submap (timestep_type start);
+        void close_submap ();
+        bool submap_full (const submap&) const;
+
+        /** Aligns the finished submaps and writes the global estimate */
+        void assemble ();
+
+    public:
+
+        submap_slam (const std::shared_ptr<const slam_data_type>&, const estimator_factory&,
+                     const boost::program_options::variables_map&, unsigned int seed);
+
+        submap_slam (const submap_slam&) = delete;
+        submap_slam& operator= (const submap_slam&) = delete;
+
+        static boost::program_options::options_description program_options ();
+
+        auto num_submaps () const -> std::size_t { return submaps.size(); }
+
+        // Overridden virtual member functions of slam::slam_data::listener
+
+        virtual void control (timestep_type, const ControlModel&) override;
+        virtual void observation (timestep_type, const typename slam_data_type::observation_info&) override;
+        virtual void timestep (timestep_type) override;
+        virtual void completed () override;
+    };
+
+
+} // namespace slam
+
+
+template <class ControlModel, class ObservationModel>
+slam::submap_slam<ControlModel, ObservationModel>
+::submap_slam (const std::shared_ptr<const slam_data_type>& data, const estimator_factory& factory,
+               const boost::program_options::variables_map& options, unsigned int seed)
+: global_data (data), make_estimator (factory), random (seed),
+max_length       (options["submap-length"].as<unsigned int>()),
+max_extent       (options["submap-extent"].as<double>()),
+align_iterations (options["submap-align-iterations"].as<unsigned int>()),
+max_finishing    (std::max (options["submap-threads"].as<unsigned int>(), 1u))
+{
+    open_submap (timestep_type (0));
+}
+
+
+template <class ControlModel, class ObservationModel>
+void slam::submap_slam<ControlModel, ObservationModel>
+::open_submap (timestep_type start) {
+    std::unique_ptr<submap> s (new submap);
+    s->start = start;
+    s->data = std::make_shared<slam_data_type>();
+    s->est = make_estimator (s->data, random());
+    submaps.push_back (std::move (s));
+}
+
+
+template <class ControlModel, class ObservationModel>
+bool slam::submap_slam<ControlModel, ObservationModel>
+::submap_full (const submap& s) const {
+    const timestep_type length = s.data->current_timestep();
+    if (max_length > 0 && length >= max_length) return true;
+    return max_extent > 0 && length > 0
+    && s.est.result->get_state (length).distance_squared() >= max_extent * max_extent;
+}
+
+
+template <class ControlModel, class ObservationModel>
+void slam::submap_slam<ControlModel, ObservationModel>
+::close_submap () {
+
+    // Bound the number of submaps finishing at once by waiting for the oldest
+    std::size_t finishing = 0;
+    for (const auto& s : submaps) {
+        if (s->finished.valid()
+            && s->finished.wait_for (std::chrono::seconds (0)) != std::future_status::ready) ++finishing;
+    }
+    for (auto iter = submaps.begin(); finishing >= max_finishing && iter != submaps.end(); ++iter) {
+        if ((*iter)->finished.valid()
+            && (*iter)->finished.wait_for (std::chrono::seconds (0)) != std::future_status::ready) {
+            (*iter)->finished.wait();
+            --finishing;
+        }
+    }
+
+    const std::shared_ptr<slam_data_type> data = submaps.back()->data;
+    submaps.back()->finished = std::async (std::launch::async, [data]() {
+        SLAM_TRACE_THREAD ("submap");
+        SLAM_TRACE_SCOPE ("submap_slam::finish");
+        data->completed();
+    });
+}
+
+
+template <class ControlModel, class ObservationModel>
+void slam::submap_slam<ControlModel, ObservationModel>
+::control (timestep_type, const ControlModel& control) {
+    submaps.back()->data->add_control (control);
+}
+
+
+template <class ControlModel, class ObservationModel>
+void slam::submap_slam<ControlModel, ObservationModel>
+::observation (timestep_type, const typename slam_data_type::observation_info& obs) {
+    submaps.back()->data->add_observation (obs.id(), obs.observation());
+}
+
+
+template <class ControlModel, class ObservationModel>
+void slam::submap_slam<ControlModel, ObservationModel>
+::timestep (timestep_type t) {
+
+    submap& current = *submaps.back();
+    assert (t == std::size_t (current.start) + current.data->current_timestep());
+    current.data->timestep (current.data->current_timestep());
+
+    if (submap_full (current)) {
+        close_submap();
+        open_submap (t);
+        // The new submap starts with this time step's observations, which link it to the last
+        for (const auto& obs : global_data->observations_at (t)) {
+            observation (t, obs.second);
+        }
+        submaps.back()->data->timestep (timestep_type (0));
+    }
+}
+
+
+template <class ControlModel, class ObservationModel>
+void slam::submap_slam<ControlModel, ObservationModel>
+::completed () {
+    close_submap();
+    for (const auto& s : submaps) s->finished.get();
+    assemble();
+}
+
+
+template <class ControlModel, class ObservationModel>
+void slam::submap_slam<ControlModel, ObservationModel>
+::assemble () {
+
+    SLAM_TRACE_SCOPE ("submap_slam::assemble", "submaps", submaps.size());
+
+    const std::size_t count = submaps.size();
+
+    // Each submap's solution in its own frame
+    std::vector<std::vector<state_type>> states (count);
+    std::vector<const feature_map_type*> maps (count);
+    std::map<featureid_type, std::vector<std::size_t>> feature_submaps;
+
+    for (std::size_t k = 0; k < count; ++k) {
+        const slam_result_type& result = *submaps[k]->est.result;
+        states[k].resize (submaps[k]->data->current_timestep() + 1);
+        result.export_states (timestep_type (0), timestep_type (states[k].size()), states[k].data());
+        maps[k] = &result.get_feature_map();
+        for (const auto& f : *maps[k]) feature_submaps[f.first].push_back (k);
+    }
+
+    // Start from the transformations that chain the boundary states together
+    std::vector<state_type> transforms (count);
+    for (std::size_t k = 1; k < count; ++k) {
+        transforms[k] = transforms[k-1] + states[k-1].back() + -states[k].front();
+    }
+
+    const feature_type origin;
+    const feature_type unit = feature_type::from_vector (feature_type::vector_type::UnitX());
+
+    for (unsigned int i = 0; i < align_iterations; ++i) {
+        for (std::size_t k = 1; k < count; ++k) {
+
+            // Pairs of (position in the common frame, position in submap k's frame)
+            std::vector<std::pair<feature_type, feature_type>> pairs;
+
+            const auto add_boundary = [&](const state_type& target, const state_type& source) {
+                pairs.emplace_back (target + origin, source + origin);
+                pairs.emplace_back (target + unit, source + unit);
+            };
+
+            add_boundary (transforms[k-1] + states[k-1].back(), states[k].front());
+            if (k+1 < count) add_boundary (transforms[k+1] + states[k+1].front(), states[k].back());
+
+            for (const auto& f : *maps[k]) {
+                for (std::size_t j : feature_submaps[f.first]) {
+                    if (j != k) pairs.emplace_back (transforms[j] + maps[j]->at (f.first), f.second);
+                }
+            }
+
+            transforms[k] = align_points (pairs);
+        }
+    }
+
+    // Concatenate the trajectories; each boundary state comes from the earlier submap
+    state_type previous = transforms[0] + states[0].front();
+    this->set_initial_state (previous);
+
+    auto& trajectory = this->get_trajectory();
+    trajectory.clear();
+    for (std::size_t k = 0; k < count; ++k) {
+        for (std::size_t t = 1; t < states[k].size(); ++t) {
+            const state_type next = transforms[k] + states[k][t];
+            trajectory.push_back (-previous + next);
+            previous = next;
+        }
+    }
+    assert (timestep_type (trajectory.size()) == global_data->current_timestep());
+
+    auto& map = this->get_feature_map();
+    map.clear();
+    map.reserve (feature_submaps.size());
+    for (const auto& f : feature_submaps) {
+        typename feature_type::vector_type sum = feature_type::vector_type::Zero();
+        for (std::size_t k : f.second) sum += (transforms[k] + maps[k]->at (f.first)).to_vector();
+        map.emplace_hint (map.end(), f.first, feature_type::from_vector (sum / double (f.second.size())));
+    }
+}
+
+
+template <class ControlModel, class ObservationModel>
+auto slam::submap_slam<ControlModel, ObservationModel>
+::program_options () -> boost::program_options::options_description {
+    namespace po = boost::program_options;
+    po::options_description options ("Submap Parameters");
+    options.add_options()
+    ("submap-seed", po::value<unsigned int>(), "submap random seed")
+    ("submap-estimator", po::value<std::string>()->default_value("mcmc"), "estimator for each submap (mcmc or g2o)")
+    ("submap-length", po::value<unsigned int>()->default_value(500), "maximum time steps in a submap (0 for no limit)")
+    ("submap-extent", po::value<double>()->default_value(0),
+     "maximum distance of the robot from a submap's origin (0 for no limit)")
+    ("submap-align-iterations", po::value<unsigned int>()->default_value(20),
+     "passes over the submaps when aligning them")
+    ("submap-threads", po::value<unsigned int>()->default_value(4), "maximum submaps finishing at once");
+    return options;
+}
+
+
+extern template class slam::submap_slam<control_model_type, observation_model_type>;
+
+#endif
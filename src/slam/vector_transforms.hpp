@@ -64,6 +64,16 @@ struct vector_transform_functors {
     };
     
     
+    /** Observation of a fixed feature, relative to the state before a control, after that control */
+    struct control_observer {
+        const feature_type& feature;
+        control_observer (const feature_type& feature) : feature(feature) { }
+        observation_vector_type operator() (const control_vector_type& control) const {
+            return ObservationModel::observe(-ControlModel::inv_observe(control) + feature);
+        }
+    };
+    
+    
     struct feature_initializer {
         const state_type& state;
         feature_initializer (const state_type& state) : state(state) { }
@@ -9,6 +9,7 @@
 #include <boost/iterator/iterator_adaptor.hpp>
 
 #include "utility/container_fwd.hpp"
+#include "utility/counters.hpp"
 
 
 namespace bitree_impl {
@@ -191,6 +192,11 @@ namespace utility {
         value_type accumulate (size_type begin, size_type end) const;
         value_type accumulate (size_type end) const { return accumulate(0, end); }
         value_type accumulate () const { return accumulate(size()); }
+        
+        /** Writes accumulate(t) for each t in [first, last) to out in a single pass. */
+        template <class OutputIterator>
+        OutputIterator accumulate_range (size_type first, size_type last, OutputIterator out) const;
+        
         size_type binary_search (const value_type& value) const;
         
     private:
@@ -275,6 +281,7 @@ namespace utility {
     ::accumulate (size_type begin, size_type end) const -> value_type {
         using namespace bitree_impl;
         assert (begin <= elements.size() && end <= elements.size());
+        SLAM_COUNT (bitree_accumulates);
         if (begin == end) {
             return value_type();
         }
@@ -291,6 +298,34 @@ namespace utility {
     }
     
     
+    template <typename Grp, typename Alloc>
+    template <class OutputIterator>
+    auto bitree<Grp, Alloc>
+    ::accumulate_range (size_type first, size_type last, OutputIterator out) const -> OutputIterator {
+        
+        using namespace bitree_impl;
+        assert (first <= last && last <= elements.size()+1);
+        
+        if (first == last) return out;
+        if (first == 0) *out++ = value_type(), ++first;
+        if (first == last) return out;
+        
+        // accumulate(i+1) == elements[0] + path[i], where path[i] is the sum of the elements on
+        // the path from the root to i, and so extends path[parent(i)] by elements[i].
+        const size_type offset = first-1;
+        std::vector<value_type> path;
+        path.reserve (last-first);
+        for (size_type i = offset; i < last-1; ++i) {
+            const size_type p = parent(i);
+            if (i == 0) path.push_back (value_type());
+            else if (p < offset) path.push_back (accumulate_relative(p, 0) + elements[i]);
+            else path.push_back (path[p-offset] + elements[i]);
+            *out++ = elements[0] + path.back();
+        }
+        return out;
+    }
+    
+    
     template <typename Grp, typename Alloc>
     void bitree<Grp, Alloc>
     ::push_back_accumulated (const value_type& value) {
@@ -0,0 +1,89 @@
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+#include "utility/counters.hpp"
+
+
+namespace {
+
+    // Blocks live until exit, so that counts from threads that have finished are still reported
+    std::mutex blocks_mutex;
+    std::vector<utility::counters::block*> blocks;
+
+    std::atomic<double> gauges[utility::counters::num_gauges];
+
+}
+
+
+auto utility::counters::register_block () -> block* {
+    block* b = new block;
+    for (auto& value : b->values) value.store (0, std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock (blocks_mutex);
+    blocks.push_back (b);
+    return b;
+}
+
+
+void utility::counters::set (gauge g, double v) {
+    gauges[g].store (v, std::memory_order_relaxed);
+}
+
+
+auto utility::counters::total (counter c) -> std::uint64_t {
+    std::lock_guard<std::mutex> lock (blocks_mutex);
+    std::uint64_t sum = 0;
+    for (const block* b : blocks) sum += b->values[c].load (std::memory_order_relaxed);
+    return sum;
+}
+
+
+auto utility::counters::value (gauge g) -> double {
+    return gauges[g].load (std::memory_order_relaxed);
+}
+
+
+auto utility::counters::name (counter c) -> const char* {
+    switch (c) {
+        case state_proposals: return "state_proposals";
+        case state_accepts: return "state_accepts";
+        case feature_proposals: return "feature_proposals";
+        case feature_accepts: return "feature_accepts";
+        case likelihood_terms: return "likelihood_terms";
+        case exact_evaluations: return "exact_evaluations";
+        case surrogate_rejects: return "surrogate_rejects";
+        case speculative_retries: return "speculative_retries";
+        case ukf_proposals: return "ukf_proposals";
+        case feature_reroots: return "feature_reroots";
+        case walk_proposals: return "walk_proposals";
+        case walk_accepts: return "walk_accepts";
+        case bitree_accumulates: return "bitree_accumulates";
+        case g2o_iterations: return "g2o_iterations";
+        case listener_calls: return "listener_calls";
+        case listener_nanoseconds: return "listener_nanoseconds";
+        default: return "unknown";
+    }
+}
+
+
+auto utility::counters::name (gauge g) -> const char* {
+    switch (g) {
+        case g2o_chi2: return "g2o_chi2";
+        case mcmc_end_acceptance: return "mcmc_end_acceptance";
+        case mcmc_end_ess: return "mcmc_end_ess";
+        case mcmc_end_ess_per_cpu_second: return "mcmc_end_ess_per_cpu_second";
+        default: return "unknown";
+    }
+}
+
+
+void utility::counters::write_json (std::ostream& out) {
+    out << "{ \"enabled\": " << (enabled() ? "true" : "false");
+    for (unsigned int c = 0; c < num_counters; ++c) {
+        out << ", \"" << name (counter (c)) << "\": " << total (counter (c));
+    }
+    for (unsigned int g = 0; g < num_gauges; ++g) {
+        out << ", \"" << name (gauge (g)) << "\": " << value (gauge (g));
+    }
+    out << " }";
+}
@@ -0,0 +1,96 @@
+#ifndef slam_counters_hpp
+#define slam_counters_hpp
+
+#include <atomic>
+#include <cstdint>
+#include <iosfwd>
+
+
+/** Hot-path event counters. They are compiled in only when SLAM_COUNTERS is defined; otherwise
+ the SLAM_COUNT macros expand to nothing. Each thread increments its own block of counters, so
+ an increment is an unshared load and store, and blocks are summed when the counters are read. */
+
+namespace utility {
+    namespace counters {
+
+        enum counter : unsigned int {
+            state_proposals,
+            state_accepts,
+            feature_proposals,
+            feature_accepts,
+            likelihood_terms,
+            exact_evaluations,
+            surrogate_rejects,
+            speculative_retries,
+            ukf_proposals,
+            feature_reroots,
+            walk_proposals,
+            walk_accepts,
+            bitree_accumulates,
+            g2o_iterations,
+            listener_calls,
+            listener_nanoseconds,
+            num_counters
+        };
+
+        enum gauge : unsigned int {
+            g2o_chi2,
+            mcmc_end_acceptance,
+            mcmc_end_ess,
+            mcmc_end_ess_per_cpu_second,
+            num_gauges
+        };
+
+        struct block {
+            std::atomic<std::uint64_t> values[num_counters];
+        };
+
+        /** The calling thread's counters, registered with the global list on first use */
+        auto register_block () -> block*;
+
+        inline auto local_block () -> block& {
+            static thread_local block* local = register_block();
+            return *local;
+        }
+
+        inline void add (counter c, std::uint64_t n = 1) {
+            auto& value = local_block().values[c];
+            value.store (value.load (std::memory_order_relaxed) + n, std::memory_order_relaxed);
+        }
+
+        /** Gauges hold the most recently recorded value */
+        void set (gauge, double);
+
+        /** Sum of the counter over all threads */
+        auto total (counter) -> std::uint64_t;
+        auto value (gauge) -> double;
+
+        auto name (counter) -> const char*;
+        auto name (gauge) -> const char*;
+
+        constexpr bool enabled () {
+#ifdef SLAM_COUNTERS
+            return true;
+#else
+            return false;
+#endif
+        }
+
+        /** Writes all counters and gauges as a JSON object */
+        void write_json (std::ostream&);
+
+    }
+}
+
+
+#ifdef SLAM_COUNTERS
+#define SLAM_COUNT(name) (::utility::counters::add (::utility::counters::name))
+#define SLAM_COUNT_N(name, n) (::utility::counters::add (::utility::counters::name, (n)))
+#define SLAM_GAUGE(name, value) (::utility::counters::set (::utility::counters::name, (value)))
+#else
+#define SLAM_COUNT(name) ((void)0)
+#define SLAM_COUNT_N(name, n) ((void)0)
+#define SLAM_GAUGE(name, value) ((void)0)
+#endif
+
+#endif
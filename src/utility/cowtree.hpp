@@ -13,6 +13,8 @@
 #include <utility>
 #include <memory>
 
+#include "utility/memory.hpp"
+
 
 class cowtree {
     
@@ -99,7 +101,9 @@ public:
     typed (const typed& o) = default;
     typed& operator= (const typed& o) = delete;
     
-    virtual std::shared_ptr<node> clone () const { return std::make_shared<typed>(*this); }
+    virtual std::shared_ptr<node> clone () const {
+        return std::allocate_shared<typed> (utility::tracked_allocator<typed, utility::memory::cowtree>(), *this);
+    }
 
 };
 
@@ -126,7 +130,8 @@ template <class T> inline T& cowtree::value () {
 }
 
 template <class T> inline std::shared_ptr<cowtree::node> cowtree::make_node (const T& value) {
-    return std::make_shared<node::typed<T>>(value);
+    using allocator = utility::tracked_allocator<node::typed<T>, utility::memory::cowtree>;
+    return std::allocate_shared<node::typed<T>> (allocator(), value);
 }
 
 
@@ -0,0 +1,90 @@
+#ifndef slam_latency_histogram_hpp
+#define slam_latency_histogram_hpp
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+
+namespace utility {
+
+
+    /** A histogram of non-negative integer values, such as latencies in nanoseconds, with
+     log-linear buckets in the manner of HdrHistogram. Values below 2^sub_bucket_bits are recorded
+     exactly; larger values fall in one of 2^(sub_bucket_bits-1) equal buckets between consecutive
+     powers of two, so every recorded value is known to a relative precision of 2^(1-sub_bucket_bits).
+     Recording a value is constant time and never allocates. */
+    class latency_histogram {
+
+        static const unsigned int sub_bucket_bits = 7;
+        static const std::uint64_t sub_bucket_count = std::uint64_t(1) << sub_bucket_bits;
+        static const std::uint64_t sub_bucket_half = sub_bucket_count / 2;
+
+        std::vector<std::uint64_t> counts;
+        std::uint64_t total = 0;
+        std::uint64_t max_value = 0;
+
+        static unsigned int msb (std::uint64_t value) {
+            unsigned int bit = 0;
+            while (value >>= 1) ++bit;
+            return bit;
+        }
+
+        static std::size_t index_of (std::uint64_t value) {
+            if (value < sub_bucket_count) return std::size_t (value);
+            const unsigned int shift = msb (value) - (sub_bucket_bits - 1);
+            return std::size_t (sub_bucket_count + (shift - 1) * sub_bucket_half + ((value >> shift) - sub_bucket_half));
+        }
+
+        /** The largest value that is recorded in the bucket at index */
+        static std::uint64_t highest_equivalent (std::size_t index) {
+            if (index < sub_bucket_count) return index;
+            const unsigned int shift = unsigned ((index - sub_bucket_count) / sub_bucket_half) + 1;
+            const std::uint64_t mantissa = (index - sub_bucket_count) % sub_bucket_half + sub_bucket_half;
+            return ((mantissa + 1) << shift) - 1;
+        }
+
+    public:
+
+        latency_histogram () : counts (index_of (~std::uint64_t(0)) + 1) { }
+
+        void record (std::uint64_t value) {
+            ++counts[index_of (value)];
+            ++total;
+            max_value = std::max (max_value, value);
+        }
+
+        void clear () {
+            std::fill (counts.begin(), counts.end(), 0);
+            total = 0;
+            max_value = 0;
+        }
+
+        void merge (const latency_histogram& other) {
+            for (std::size_t i = 0; i < counts.size(); ++i) counts[i] += other.counts[i];
+            total += other.total;
+            max_value = std::max (max_value, other.max_value);
+        }
+
+        std::uint64_t count () const { return total; }
+        std::uint64_t max () const { return max_value; }
+
+        /** The smallest recorded value v such that a fraction q of all values is at most v, up to
+         the precision of the buckets. Returns zero if the histogram is empty. */
+        std::uint64_t percentile (double q) const {
+            if (total == 0) return 0;
+            const std::uint64_t rank = std::max<std::uint64_t> (1, std::uint64_t (std::ceil (q * total)));
+            std::uint64_t seen = 0;
+            for (std::size_t i = 0; i < counts.size(); ++i) {
+                seen += counts[i];
+                if (seen >= rank) return std::min (highest_equivalent (i), max_value);
+            }
+            return max_value;
+        }
+    };
+
+
+}
+
+#endif
@@ -12,6 +12,9 @@
 #include <vector>
 #include <algorithm>
 #include <memory>
+#include <chrono>
+
+#include "utility/counters.hpp"
 
 
 namespace utility {
@@ -36,7 +39,16 @@ namespace utility {
         
         auto invoke_or_remove = [&f](const std::weak_ptr<Listener>& weak_ptr) -> bool {
             if (auto listener = weak_ptr.lock()) {
+#ifdef SLAM_COUNTERS
+                const auto start = std::chrono::steady_clock::now();
+                f (listener.get());
+                const auto elapsed = std::chrono::steady_clock::now() - start;
+                SLAM_COUNT (listener_calls);
+                SLAM_COUNT_N (listener_nanoseconds,
+                              std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+#else
                 f (listener.get());
+#endif
                 return false;
             }
             else {
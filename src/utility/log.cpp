@@ -0,0 +1,218 @@
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "utility/log.hpp"
+
+
+std::atomic<unsigned int> utility::log::runtime_level (utility::log::info);
+
+
+namespace {
+
+    using utility::log::field;
+    using utility::log::level;
+
+    using clock = std::chrono::steady_clock;
+    const auto epoch = clock::now();
+
+    struct record {
+        level l;
+        std::uint64_t time_ns;
+        const char* event;
+        unsigned int num_fields;
+        field fields[utility::log::max_fields];
+    };
+
+
+    /** Bounded multi-producer, single-consumer queue. Each cell's sequence number tells producers
+     and the consumer whose turn it is, so neither side takes a lock. */
+    class ring_buffer {
+
+        struct cell {
+            std::atomic<std::uint64_t> sequence;
+            record value;
+        };
+
+        const std::uint64_t mask;
+        std::unique_ptr<cell[]> cells;
+
+        std::atomic<std::uint64_t> enqueue_pos;
+        std::uint64_t dequeue_pos = 0;
+
+    public:
+
+        explicit ring_buffer (std::size_t capacity) : mask (capacity-1), cells (new cell[capacity]), enqueue_pos (0) {
+            assert ((capacity & mask) == 0);
+            for (std::size_t i = 0; i < capacity; ++i) cells[i].sequence.store (i, std::memory_order_relaxed);
+        }
+
+        bool push (const record& r) {
+            std::uint64_t pos = enqueue_pos.load (std::memory_order_relaxed);
+            while (true) {
+                cell& c = cells[pos & mask];
+                const std::uint64_t seq = c.sequence.load (std::memory_order_acquire);
+                const std::int64_t diff = std::int64_t (seq) - std::int64_t (pos);
+                if (diff == 0) {
+                    if (enqueue_pos.compare_exchange_weak (pos, pos+1, std::memory_order_relaxed)) {
+                        c.value = r;
+                        c.sequence.store (pos+1, std::memory_order_release);
+                        return true;
+                    }
+                }
+                else if (diff < 0) return false;
+                else pos = enqueue_pos.load (std::memory_order_relaxed);
+            }
+        }
+
+        /** Only called by the consumer */
+        bool pop (record& r) {
+            cell& c = cells[dequeue_pos & mask];
+            if (c.sequence.load (std::memory_order_acquire) != dequeue_pos+1) return false;
+            r = c.value;
+            c.sequence.store (dequeue_pos + mask + 1, std::memory_order_release);
+            ++dequeue_pos;
+            return true;
+        }
+
+        std::uint64_t pushed () const { return enqueue_pos.load (std::memory_order_acquire); }
+        std::uint64_t popped () const { return dequeue_pos; }
+    };
+
+
+    class logger {
+
+        ring_buffer queue;
+        std::atomic<std::uint64_t> dropped;
+        std::atomic<std::uint64_t> output_pos;
+        std::atomic<bool> stopping;
+
+        std::mutex output_mutex;
+        std::unique_ptr<std::ofstream> file;
+        std::ostream* out = &std::clog;
+
+        std::thread drain_thread;
+
+        static const char* level_name (level l) {
+            switch (l) {
+                case utility::log::debug: return "debug";
+                case utility::log::info: return "info";
+                case utility::log::warning: return "warning";
+                case utility::log::error: return "error";
+                default: return "unknown";
+            }
+        }
+
+        void format (const record& r) {
+            *out << '[' << std::fixed << std::setprecision (6) << std::setw (12) << r.time_ns * 1e-9 << "] "
+            << std::left << std::setw (8) << level_name (r.l) << std::right << r.event;
+            out->unsetf (std::ios::floatfield);
+            *out << std::setprecision (6);
+            for (unsigned int i = 0; i < r.num_fields; ++i) *out << ' ' << r.fields[i].key << '=' << r.fields[i].value;
+            *out << '\n';
+        }
+
+        /** Writes everything in the queue; returns false if it was already empty */
+        bool drain () {
+            std::lock_guard<std::mutex> lock (output_mutex);
+            record r;
+            bool any = false;
+            while (queue.pop (r)) {
+                format (r);
+                any = true;
+            }
+            if (const std::uint64_t n = dropped.exchange (0, std::memory_order_relaxed)) {
+                *out << "log: dropped " << n << " messages because the buffer was full\n";
+            }
+            if (any) out->flush();
+            output_pos.store (queue.popped(), std::memory_order_release);
+            return any;
+        }
+
+        void drain_loop () {
+            while (!stopping.load (std::memory_order_acquire)) {
+                if (!drain()) std::this_thread::sleep_for (std::chrono::milliseconds (2));
+            }
+            drain();
+        }
+
+    public:
+
+        logger () : queue (8192), dropped (0), output_pos (0), stopping (false) {
+            drain_thread = std::thread (&logger::drain_loop, this);
+        }
+
+        ~logger () {
+            stopping.store (true, std::memory_order_release);
+            drain_thread.join();
+        }
+
+        void write (const record& r) {
+            if (!queue.push (r)) dropped.fetch_add (1, std::memory_order_relaxed);
+        }
+
+        void set_file (const std::string& name) {
+            std::unique_ptr<std::ofstream> opened (new std::ofstream (name));
+            if (!*opened) {
+                std::cerr << "Could not write log file: " << name << std::endl;
+                std::exit (EXIT_FAILURE);
+            }
+            std::lock_guard<std::mutex> lock (output_mutex);
+            file = std::move (opened);
+            out = file.get();
+        }
+
+        void flush () {
+            const std::uint64_t target = queue.pushed();
+            while (output_pos.load (std::memory_order_acquire) < target) {
+                std::this_thread::sleep_for (std::chrono::milliseconds (1));
+            }
+        }
+    };
+
+    logger& instance () {
+        static logger l;
+        return l;
+    }
+
+}
+
+
+void utility::log::write (level l, const char* event, std::initializer_list<field> fields) {
+    assert (fields.size() <= max_fields);
+    record r;
+    r.l = l;
+    r.time_ns = std::chrono::duration_cast<std::chrono::nanoseconds> (clock::now() - epoch).count();
+    r.event = event;
+    r.num_fields = unsigned (std::min<std::size_t> (fields.size(), max_fields));
+    std::copy_n (fields.begin(), r.num_fields, r.fields);
+    instance().write (r);
+}
+
+
+void utility::log::configure (level l, const std::string& file) {
+    runtime_level.store (l, std::memory_order_relaxed);
+    if (!file.empty()) instance().set_file (file);
+}
+
+
+auto utility::log::parse_level (const std::string& name) -> level {
+    if (name == "debug") return debug;
+    if (name == "info") return info;
+    if (name == "warning") return warning;
+    if (name == "error") return error;
+    std::cerr << "Unknown log level: " << name << std::endl;
+    std::exit (EXIT_FAILURE);
+}
+
+
+void utility::log::flush () {
+    instance().flush();
+}
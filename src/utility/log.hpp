@@ -0,0 +1,80 @@
+#ifndef slam_log_hpp
+#define slam_log_hpp
+
+#include <atomic>
+#include <cstdint>
+#include <initializer_list>
+#include <string>
+
+
+/** Asynchronous structured logging. A message is an event name and up to max_fields named numeric
+ fields, all of which are copied into a lock-free ring buffer by the caller; a background thread
+ formats and writes them, so logging never blocks on output. Event and field names must be string
+ literals. Messages below SLAM_LOG_MIN_LEVEL are removed at compile time, and those below the
+ runtime level cost one relaxed load. If the ring buffer is full the message is dropped and
+ counted. */
+
+#ifndef SLAM_LOG_MIN_LEVEL
+#define SLAM_LOG_MIN_LEVEL 1
+#endif
+
+namespace utility {
+    namespace log {
+
+        enum level : unsigned int { debug = 0, info = 1, warning = 2, error = 3 };
+
+        struct field {
+            const char* key;
+            double value;
+
+            field () = default;
+            template <class T> field (const char* key, T value) : key (key), value (double (value)) { }
+        };
+
+        const unsigned int max_fields = 4;
+
+        extern std::atomic<unsigned int> runtime_level;
+
+        inline bool enabled (level l) {
+            return l >= runtime_level.load (std::memory_order_relaxed);
+        }
+
+        void write (level, const char* event, std::initializer_list<field> fields = {});
+
+        /** Sets the runtime level and, unless file is empty, writes to file instead of std::clog.
+         Exits with an error message if the file cannot be opened. */
+        void configure (level, const std::string& file = "");
+
+        auto parse_level (const std::string&) -> level;
+
+        /** Blocks until every message written so far has been output */
+        void flush ();
+
+    }
+}
+
+
+#define SLAM_LOG_AT(l, ...) \
+    (::utility::log::enabled (l) ? ::utility::log::write (l, __VA_ARGS__) : (void)0)
+
+#if SLAM_LOG_MIN_LEVEL <= 0
+#define SLAM_LOG_DEBUG(...) SLAM_LOG_AT (::utility::log::debug, __VA_ARGS__)
+#else
+#define SLAM_LOG_DEBUG(...) ((void)0)
+#endif
+
+#if SLAM_LOG_MIN_LEVEL <= 1
+#define SLAM_LOG_INFO(...) SLAM_LOG_AT (::utility::log::info, __VA_ARGS__)
+#else
+#define SLAM_LOG_INFO(...) ((void)0)
+#endif
+
+#if SLAM_LOG_MIN_LEVEL <= 2
+#define SLAM_LOG_WARNING(...) SLAM_LOG_AT (::utility::log::warning, __VA_ARGS__)
+#else
+#define SLAM_LOG_WARNING(...) ((void)0)
+#endif
+
+#define SLAM_LOG_ERROR(...) SLAM_LOG_AT (::utility::log::error, __VA_ARGS__)
+
+#endif
@@ -0,0 +1,29 @@
+#include <iostream>
+
+#include "utility/memory.hpp"
+
+
+std::atomic<std::int64_t> utility::memory::live[num_tags];
+std::atomic<std::int64_t> utility::memory::peak[num_tags];
+
+
+auto utility::memory::name (tag t) -> const char* {
+    switch (t) {
+        case slam_data: return "slam_data";
+        case mcmc_slam: return "mcmc_slam";
+        case g2o_slam: return "g2o_slam";
+        case fastslam: return "fastslam";
+        case cowtree: return "cowtree";
+        default: return "unknown";
+    }
+}
+
+
+void utility::memory::write_json (std::ostream& out) {
+    out << "{ \"enabled\": " << (enabled() ? "true" : "false");
+    for (unsigned int t = 0; t < num_tags; ++t) {
+        out << ", \"" << name (tag (t)) << "\": { \"live_bytes\": " << live[t].load (std::memory_order_relaxed)
+        << ", \"peak_bytes\": " << peak[t].load (std::memory_order_relaxed) << " }";
+    }
+    out << " }";
+}
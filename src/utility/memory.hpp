@@ -0,0 +1,91 @@
+#ifndef slam_memory_hpp
+#define slam_memory_hpp
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+
+
+/** Live and peak heap bytes for each subsystem. Containers and allocate_shared take a
+ tracked_allocator tagged with the owning subsystem. It is only a tracking allocator when
+ SLAM_MEMORY_TRACKING is defined; otherwise it is std::allocator, so a disabled build is unchanged. */
+
+namespace utility {
+    namespace memory {
+
+        enum tag : unsigned int {
+            slam_data,
+            mcmc_slam,
+            g2o_slam,
+            fastslam,
+            cowtree,
+            num_tags
+        };
+
+        extern std::atomic<std::int64_t> live[num_tags];
+        extern std::atomic<std::int64_t> peak[num_tags];
+
+        inline void allocated (tag t, std::size_t bytes) {
+            const std::int64_t now = live[t].fetch_add (bytes, std::memory_order_relaxed) + bytes;
+            std::int64_t old_peak = peak[t].load (std::memory_order_relaxed);
+            while (now > old_peak && !peak[t].compare_exchange_weak (old_peak, now, std::memory_order_relaxed));
+        }
+
+        inline void deallocated (tag t, std::size_t bytes) {
+            live[t].fetch_sub (bytes, std::memory_order_relaxed);
+        }
+
+        auto name (tag) -> const char*;
+
+        constexpr bool enabled () {
+#ifdef SLAM_MEMORY_TRACKING
+            return true;
+#else
+            return false;
+#endif
+        }
+
+        /** Writes live and peak bytes for each tag as a JSON object */
+        void write_json (std::ostream&);
+
+
+        /** A std::allocator that counts its allocations against Tag */
+        template <class T, tag Tag>
+        struct tracking_allocator {
+
+            using value_type = T;
+
+            template <class U> struct rebind { using other = tracking_allocator<U, Tag>; };
+
+            tracking_allocator () noexcept { }
+            template <class U> tracking_allocator (const tracking_allocator<U, Tag>&) noexcept { }
+
+            T* allocate (std::size_t n) {
+                T* p = std::allocator<T>().allocate (n);
+                allocated (Tag, n * sizeof(T));
+                return p;
+            }
+
+            void deallocate (T* p, std::size_t n) noexcept {
+                deallocated (Tag, n * sizeof(T));
+                std::allocator<T>().deallocate (p, n);
+            }
+
+            template <class U> bool operator== (const tracking_allocator<U, Tag>&) const noexcept { return true; }
+            template <class U> bool operator!= (const tracking_allocator<U, Tag>&) const noexcept { return false; }
+        };
+
+    }
+
+
+#ifdef SLAM_MEMORY_TRACKING
+    template <class T, memory::tag Tag> using tracked_allocator = memory::tracking_allocator<T, Tag>;
+#else
+    template <class T, memory::tag Tag> using tracked_allocator = std::allocator<T>;
+#endif
+
+}
+
+#endif
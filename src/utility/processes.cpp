@@ -0,0 +1,62 @@
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <iostream>
+
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "utility/processes.hpp"
+
+
+utility::shared_region::shared_region (std::size_t size)
+: addr (mmap (nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0)), length (size)
+{
+    if (addr == MAP_FAILED) {
+        std::cerr << "Could not map " << size << " bytes of shared memory: " << std::strerror (errno) << '\n';
+        std::exit (EXIT_FAILURE);
+    }
+}
+
+
+utility::shared_region::~shared_region () {
+    munmap (addr, length);
+}
+
+
+auto utility::run_processes (unsigned int n, const std::function<int(unsigned int)>& body) -> std::vector<bool> {
+
+    // Buffered output would otherwise be written again by each child
+    std::cout.flush();
+    std::cerr.flush();
+    std::fflush (nullptr);
+
+    std::vector<pid_t> children (n, -1);
+    for (unsigned int i = 0; i < n; ++i) {
+        const pid_t pid = fork();
+        if (pid == 0) {
+            int status = EXIT_FAILURE;
+            try { status = body (i); }
+            catch (const std::exception& e) { std::cerr << "Worker process " << i << ": " << e.what() << '\n'; }
+            std::cout.flush();
+            std::cerr.flush();
+            _exit (status);
+        }
+        if (pid < 0) std::cerr << "Could not start worker process " << i << ": " << std::strerror (errno) << '\n';
+        children[i] = pid;
+    }
+
+    std::vector<bool> succeeded (n, false);
+    for (unsigned int i = 0; i < n; ++i) {
+        if (children[i] < 0) continue;
+        int status = 0;
+        pid_t result;
+        while ((result = waitpid (children[i], &status, 0)) < 0 && errno == EINTR) { }
+        succeeded[i] = result == children[i] && WIFEXITED (status) && WEXITSTATUS (status) == 0;
+    }
+    return succeeded;
+}
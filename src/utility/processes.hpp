@@ -0,0 +1,41 @@
+#ifndef _UTILITY_PROCESSES_HPP
+#define _UTILITY_PROCESSES_HPP
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+
+namespace utility {
+
+
+    /** Anonymous memory shared between this process and the child processes it forks after
+     creating it. The memory is zero-initialised. */
+    class shared_region {
+
+        void* addr;
+        std::size_t length;
+
+    public:
+
+        explicit shared_region (std::size_t size);
+        ~shared_region ();
+
+        shared_region (const shared_region&) = delete;
+        shared_region& operator= (const shared_region&) = delete;
+
+        auto data () const -> char* { return static_cast<char*> (addr); }
+        auto size () const -> std::size_t { return length; }
+    };
+
+
+    /** Runs body(i) for each i below n, each in its own forked child process, and waits for them
+     all. The children start with a copy-on-write image of this process, of which only the calling
+     thread is running; a child exits with the status returned by body, without running exit
+     handlers. Returns, for each child, whether it exited normally with status zero. */
+    auto run_processes (unsigned int n, const std::function<int(unsigned int)>& body) -> std::vector<bool>;
+
+
+}
+
+#endif
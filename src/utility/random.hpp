@@ -108,6 +108,17 @@ public:
         return likelihood_exponent(x) - vector_dim*log_root_two_pi - chol_cov_log_det();
     }
     
+    /** The log likelihood, without its constant term, of each column of x. Differences of these
+     are log likelihood ratios. */
+    template <class Matrix>
+    auto likelihood_exponents (Matrix x) const
+    -> Eigen::Array<double, 1, Matrix::ColsAtCompileTime, Eigen::RowMajor, 1, Matrix::MaxColsAtCompileTime> {
+        static_assert (Matrix::RowsAtCompileTime == N, "columns must be vectors of this distribution");
+        for (int c = 0; c < x.cols(); ++c) x.col(c) = subtract (x.col(c), mean());
+        derived().chol_cov_solve_columns(x);
+        return -0.5 * x.colwise().squaredNorm().array();
+    }
+    
 };
 
 
@@ -142,6 +153,11 @@ public:
         m_chol_cov.template triangularView<Eigen::Lower>().solveInPlace(v);
     }
     
+    template <class Matrix>
+    void chol_cov_solve_columns (Matrix& m) const {
+        m_chol_cov.template triangularView<Eigen::Lower>().solveInPlace(m);
+    }
+    
     auto chol_cov_det () const -> double {
         return m_chol_cov.diagonal().array().product();
     }
@@ -229,6 +245,9 @@ public:
     
     void chol_cov_solve (vector_type& v) const { v.array() /= m_stddev.array(); }
     
+    template <class Matrix>
+    void chol_cov_solve_columns (Matrix& m) const { m.array().colwise() /= m_stddev.array(); }
+    
     auto chol_cov_det () const -> double { return m_stddev.array().prod(); }
     
     auto chol_cov_log_det () const -> double { return m_stddev.array().log().sum(); }
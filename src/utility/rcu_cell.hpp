@@ -0,0 +1,142 @@
+#ifndef slam_rcu_cell_hpp
+#define slam_rcu_cell_hpp
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+
+namespace utility {
+
+
+    /** Holds the latest of a sequence of immutable values published by one writer thread, for
+     readers on any thread. Reclamation is epoch based, in the manner of RCU: a reader announces the
+     epoch in which it starts reading, and a replaced value is destroyed by a later publish once
+     every reader that could still see it has finished. Reading is wait-free (a fixed number of
+     atomic operations) and publishing never waits for readers; a reader that holds on to a value
+     only delays its destruction. Each reading thread needs its own reader, and at most max_readers
+     may exist at once. */
+    template <class T>
+    class rcu_cell {
+
+    public:
+
+        static const std::size_t max_readers = 32;
+
+    private:
+
+        struct reader_slot {
+            std::atomic<std::uint64_t> active;  // Epoch when the current read began, or 0
+            std::atomic<bool> in_use;
+            reader_slot () : active (0), in_use (false) { }
+        };
+
+        std::atomic<const T*> current;
+        std::atomic<std::uint64_t> epoch;
+        reader_slot slots[max_readers];
+
+        // Only accessed by the writer
+        std::vector<std::pair<std::uint64_t, std::unique_ptr<const T>>> retired;
+
+        void reclaim ();
+
+    public:
+
+        class reader;
+
+        /** Access to the value that was current when reading began, until destruction */
+        class read_guard {
+            friend class reader;
+            const T* value;
+            reader_slot* slot;
+            read_guard (const T* value, reader_slot* slot) : value (value), slot (slot) { }
+        public:
+            read_guard (read_guard&& o) : value (o.value), slot (o.slot) { o.slot = nullptr; }
+            ~read_guard () { if (slot) slot->active.store (0, std::memory_order_release); }
+            read_guard (const read_guard&) = delete;
+            read_guard& operator= (const read_guard&) = delete;
+
+            /** Null if nothing has been published yet */
+            const T* get () const { return value; }
+            const T& operator* () const { assert (value); return *value; }
+            const T* operator-> () const { assert (value); return value; }
+            explicit operator bool () const { return value != nullptr; }
+        };
+
+        class reader {
+            rcu_cell* cell;
+            reader_slot* slot;
+        public:
+            explicit reader (rcu_cell&);
+            ~reader () { slot->in_use.store (false, std::memory_order_release); }
+            reader (const reader&) = delete;
+            reader& operator= (const reader&) = delete;
+
+            /** Only one read_guard per reader may be alive at a time */
+            read_guard read () const {
+                assert (slot->active.load (std::memory_order_relaxed) == 0);
+                slot->active.store (cell->epoch.load (std::memory_order_seq_cst), std::memory_order_seq_cst);
+                return read_guard (cell->current.load (std::memory_order_seq_cst), slot);
+            }
+        };
+
+        rcu_cell () : current (nullptr), epoch (1) { }
+
+        ~rcu_cell () {
+            delete current.load();
+        }
+
+        rcu_cell (const rcu_cell&) = delete;
+        rcu_cell& operator= (const rcu_cell&) = delete;
+
+        /** Replaces the current value. Only one thread may publish. */
+        void publish (std::unique_ptr<const T> value);
+
+        /** The number of replaced values that are waiting for readers to finish */
+        std::size_t num_retired () const { return retired.size(); }
+    };
+
+
+    template <class T>
+    rcu_cell<T>::reader::reader (rcu_cell& cell) : cell (&cell), slot (nullptr) {
+        for (auto& s : cell.slots) {
+            bool expected = false;
+            if (s.in_use.compare_exchange_strong (expected, true, std::memory_order_acq_rel)) {
+                slot = &s;
+                return;
+            }
+        }
+        throw std::length_error ("rcu_cell: too many readers");
+    }
+
+
+    template <class T>
+    void rcu_cell<T>::publish (std::unique_ptr<const T> value) {
+        const T* old = current.exchange (value.release(), std::memory_order_seq_cst);
+        // Readers that announced an epoch up to retired_epoch may still hold old
+        const std::uint64_t retired_epoch = epoch.fetch_add (1, std::memory_order_seq_cst);
+        if (old) retired.emplace_back (retired_epoch, std::unique_ptr<const T> (old));
+        reclaim();
+    }
+
+
+    template <class T>
+    void rcu_cell<T>::reclaim () {
+        std::uint64_t oldest_reader = UINT64_MAX;
+        for (const auto& s : slots) {
+            const std::uint64_t active = s.active.load (std::memory_order_seq_cst);
+            if (active != 0 && active < oldest_reader) oldest_reader = active;
+        }
+        auto end = retired.begin();
+        while (end != retired.end() && end->first < oldest_reader) ++end;
+        retired.erase (retired.begin(), end);
+    }
+
+
+}
+
+#endif
@@ -0,0 +1,78 @@
+#include <algorithm>
+#include <cassert>
+
+#include "utility/thread_pool.hpp"
+#include "utility/trace.hpp"
+
+
+utility::thread_pool::thread_pool (unsigned int threads)
+: next_index (0)
+{
+    if (threads == 0) threads = std::max (std::thread::hardware_concurrency(), 1u);
+    for (unsigned int i = 1; i < threads; ++i) workers.emplace_back (&thread_pool::worker_loop, this, i);
+}
+
+
+utility::thread_pool::~thread_pool () {
+    {
+        std::lock_guard<std::mutex> lock (mutex);
+        stopping = true;
+    }
+    loop_started.notify_all();
+    for (auto& w : workers) w.join();
+}
+
+
+void utility::thread_pool::parallel_for (std::size_t n, const loop_body& f) {
+
+    if (workers.empty() || n <= 1) {
+        for (std::size_t i = 0; i < n; ++i) f (i, 0);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock (mutex);
+        assert (!body && "parallel_for is not reentrant");
+        body = &f;
+        count = n;
+        next_index = 0;
+        workers_busy = unsigned (workers.size());
+        ++loop;
+    }
+    loop_started.notify_all();
+
+    run_iterations (f, n, 0);
+
+    std::unique_lock<std::mutex> lock (mutex);
+    loop_finished.wait (lock, [this]{ return workers_busy == 0; });
+    body = nullptr;
+}
+
+
+void utility::thread_pool::run_iterations (const loop_body& f, std::size_t n, unsigned int thread) {
+    for (std::size_t i = next_index++; i < n; i = next_index++) f (i, thread);
+}
+
+
+void utility::thread_pool::worker_loop (unsigned int thread) {
+    SLAM_TRACE_THREAD ("thread_pool worker");
+    unsigned long last_loop = 0;
+    while (true) {
+        const loop_body* f;
+        std::size_t n;
+        {
+            std::unique_lock<std::mutex> lock (mutex);
+            loop_started.wait (lock, [&]{ return stopping || loop != last_loop; });
+            if (stopping) return;
+            last_loop = loop;
+            f = body;
+            n = count;
+        }
+        run_iterations (*f, n, thread);
+        {
+            std::lock_guard<std::mutex> lock (mutex);
+            --workers_busy;
+        }
+        loop_finished.notify_all();
+    }
+}
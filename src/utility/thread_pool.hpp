@@ -0,0 +1,61 @@
+#ifndef _UTILITY_THREAD_POOL_HPP
+#define _UTILITY_THREAD_POOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+namespace utility {
+
+
+    /** A fixed set of worker threads for running parallel loops. The calling thread takes part in
+     each loop, so a pool of n threads has n-1 workers. Loops are run one at a time; parallel_for
+     must not be called from inside a loop body. */
+    class thread_pool {
+
+    public:
+
+        /** Called with the index of an iteration and the number (below num_threads) of the thread
+         running it; no two iterations run on the same thread number at once. */
+        using loop_body = std::function<void(std::size_t index, unsigned int thread)>;
+
+        /** Zero threads means one per hardware thread */
+        explicit thread_pool (unsigned int threads);
+        ~thread_pool ();
+
+        thread_pool (const thread_pool&) = delete;
+        thread_pool& operator= (const thread_pool&) = delete;
+
+        auto num_threads () const -> unsigned int { return unsigned (workers.size()) + 1; }
+
+        /** Calls body for every index below count, returning when all calls have finished.
+         Indices are handed out in increasing order to whichever thread is free. */
+        void parallel_for (std::size_t count, const loop_body& body);
+
+    private:
+
+        std::mutex mutex;
+        std::condition_variable loop_started, loop_finished;
+
+        const loop_body* body = nullptr;
+        std::size_t count = 0;
+        std::atomic<std::size_t> next_index;
+        unsigned long loop = 0;
+        unsigned int workers_busy = 0;
+        bool stopping = false;
+
+        std::vector<std::thread> workers;
+
+        void run_iterations (const loop_body&, std::size_t count, unsigned int thread);
+        void worker_loop (unsigned int thread);
+    };
+
+
+}
+
+#endif
@@ -0,0 +1,131 @@
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+#include "utility/trace.hpp"
+
+
+std::atomic<bool> utility::trace::recording (false);
+
+
+namespace {
+
+    const std::size_t chunk_size = 4096;
+
+    // Only the owning thread appends to a chunk; size and next are published with release stores
+    // so that write_json can read a consistent prefix without locking
+    struct chunk {
+        utility::trace::event events[chunk_size];
+        std::atomic<std::size_t> size;
+        std::atomic<chunk*> next;
+        chunk () : size (0), next (nullptr) { }
+    };
+
+    struct thread_buffer {
+        unsigned int tid;
+        std::atomic<const char*> name;
+        chunk head;
+        chunk* tail;
+        thread_buffer (unsigned int tid) : tid (tid), name (nullptr), tail (&head) { }
+    };
+
+    const auto epoch = std::chrono::steady_clock::now();
+
+    // Buffers live until exit, so that events from threads that have finished are still written
+    std::mutex buffers_mutex;
+    std::vector<thread_buffer*> buffers;
+
+    auto register_buffer () -> thread_buffer* {
+        std::lock_guard<std::mutex> lock (buffers_mutex);
+        buffers.push_back (new thread_buffer (buffers.size() + 1));
+        return buffers.back();
+    }
+
+    auto local_buffer () -> thread_buffer& {
+        static thread_local thread_buffer* local = register_buffer();
+        return *local;
+    }
+
+    void write_timestamp (std::ostream& out, std::uint64_t ns) {
+        out << ns / 1000 << '.' << std::setw(3) << std::setfill('0') << ns % 1000;
+    }
+
+}
+
+
+void utility::trace::start () {
+    recording.store (true, std::memory_order_relaxed);
+}
+
+
+void utility::trace::stop () {
+    recording.store (false, std::memory_order_relaxed);
+}
+
+
+auto utility::trace::now_ns () -> std::uint64_t {
+    return std::chrono::duration_cast<std::chrono::nanoseconds> (std::chrono::steady_clock::now() - epoch).count();
+}
+
+
+void utility::trace::record (const event& e) {
+    thread_buffer& buffer = local_buffer();
+    std::size_t n = buffer.tail->size.load (std::memory_order_relaxed);
+    if (n == chunk_size) {
+        chunk* next = new chunk;
+        buffer.tail->next.store (next, std::memory_order_release);
+        buffer.tail = next;
+        n = 0;
+    }
+    buffer.tail->events[n] = e;
+    buffer.tail->size.store (n+1, std::memory_order_release);
+}
+
+
+void utility::trace::set_thread_name (const char* name) {
+    local_buffer().name.store (name, std::memory_order_release);
+}
+
+
+void utility::trace::write_json (std::ostream& out) {
+
+    std::vector<thread_buffer*> threads;
+    {
+        std::lock_guard<std::mutex> lock (buffers_mutex);
+        threads = buffers;
+    }
+
+    out << "{ \"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+
+    bool first = true;
+    const auto separator = [&]() -> std::ostream& {
+        out << (first ? "\n" : ",\n");
+        first = false;
+        return out;
+    };
+
+    for (const thread_buffer* buffer : threads) {
+
+        const char* name = buffer->name.load (std::memory_order_acquire);
+        separator() << "{ \"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << buffer->tid
+        << ", \"args\": { \"name\": \"" << (name ? name : (buffer->tid == 1 ? "main" : "worker")) << "\" } }";
+
+        for (const chunk* c = &buffer->head; c; c = c->next.load (std::memory_order_acquire)) {
+            const std::size_t size = c->size.load (std::memory_order_acquire);
+            for (std::size_t i = 0; i < size; ++i) {
+                const event& e = c->events[i];
+                separator() << "{ \"name\": \"" << e.name << "\", \"cat\": \"slam\", \"ph\": \"X\", \"pid\": 1, \"tid\": "
+                << buffer->tid << ", \"ts\": ";
+                write_timestamp (out, e.begin_ns);
+                out << ", \"dur\": ";
+                write_timestamp (out, e.duration_ns);
+                if (e.arg_name) out << ", \"args\": { \"" << e.arg_name << "\": " << e.arg << " }";
+                out << " }";
+            }
+        }
+    }
+
+    out << "\n] }\n";
+}
@@ -0,0 +1,93 @@
+#ifndef slam_trace_hpp
+#define slam_trace_hpp
+
+#include <atomic>
+#include <cstdint>
+#include <iosfwd>
+
+
+/** Scoped timeline tracing in the Chrome trace-event format, which Perfetto and chrome://tracing
+ can display. Instrumentation is compiled in only when SLAM_TRACING is defined, and records nothing
+ until start() is called, so a disabled scope costs a single relaxed load. Each thread appends
+ completed scopes to its own buffer without locking; the buffers are written out by write_json. */
+
+namespace utility {
+    namespace trace {
+
+        struct event {
+            const char* name;
+            const char* arg_name;
+            std::int64_t arg;
+            std::uint64_t begin_ns;
+            std::uint64_t duration_ns;
+        };
+
+        extern std::atomic<bool> recording;
+
+        inline bool enabled () {
+            return recording.load (std::memory_order_relaxed);
+        }
+
+        /** Starts recording events. Timestamps are relative to program start. */
+        void start ();
+
+        /** Stops recording. Events already recorded are kept for write_json. */
+        void stop ();
+
+        auto now_ns () -> std::uint64_t;
+
+        /** Appends a completed event to the calling thread's buffer. Names must be string literals
+         or otherwise outlive the trace. */
+        void record (const event&);
+
+        /** Names the calling thread in the trace */
+        void set_thread_name (const char*);
+
+        /** Writes every thread's events. Threads still recording are read only up to the events
+         they had published when the call began. */
+        void write_json (std::ostream&);
+
+
+        /** Records the lifetime of the scope as one event */
+        class scope {
+
+            event e;
+
+        public:
+
+            explicit scope (const char* name, const char* arg_name = nullptr, std::int64_t arg = 0) {
+                e.name = enabled() ? name : nullptr;
+                if (e.name) {
+                    e.arg_name = arg_name;
+                    e.arg = arg;
+                    e.begin_ns = now_ns();
+                }
+            }
+
+            ~scope () {
+                if (e.name) {
+                    e.duration_ns = now_ns() - e.begin_ns;
+                    record (e);
+                }
+            }
+
+            scope (const scope&) = delete;
+            scope& operator= (const scope&) = delete;
+        };
+
+    }
+}
+
+
+#define SLAM_TRACE_CONCAT_IMPL(a, b) a ## b
+#define SLAM_TRACE_CONCAT(a, b) SLAM_TRACE_CONCAT_IMPL(a, b)
+
+#ifdef SLAM_TRACING
+#define SLAM_TRACE_SCOPE(...) ::utility::trace::scope SLAM_TRACE_CONCAT(slam_trace_scope_, __LINE__) (__VA_ARGS__)
+#define SLAM_TRACE_THREAD(name) (::utility::trace::set_thread_name (name))
+#else
+#define SLAM_TRACE_SCOPE(...) ((void)0)
+#define SLAM_TRACE_THREAD(name) ((void)0)
+#endif
+
+#endif
@@ -7,14 +7,63 @@
 //
 
 #include <stdio.h>
+#include <algorithm>
+#include <cmath>
 
 #include "utility/utility.hpp"
 
 std::shared_ptr<FILE> utility::open_file (const char* filename, const char* mode) {
-    return std::shared_ptr<FILE> (fopen (filename, mode), &fclose);
+    FILE* file = fopen (filename, mode);
+    if (!file) return nullptr;
+    return std::shared_ptr<FILE> (file, &fclose);
 }
 
 std::shared_ptr<FILE> utility::open_process (const char* command, const char* mode) {
-    return std::shared_ptr<FILE> (popen (command, mode), &pclose);
+    FILE* process = popen (command, mode);
+    if (!process) return nullptr;
+    return std::shared_ptr<FILE> (process, &pclose);
 }
 
+
+double utility::effective_sample_size (const std::vector<double>& values) {
+
+    const std::size_t n = values.size();
+    const std::size_t batch = std::size_t (std::sqrt (double (n)));
+    const std::size_t batches = batch > 0 ? n / batch : 0;
+    if (batches < 2) return double (n);
+
+    double mean = 0;
+    for (double v : values) mean += v;
+    mean /= n;
+
+    double variance = 0;
+    for (double v : values) variance += (v - mean) * (v - mean);
+    variance /= n - 1;
+    if (!(variance > 0)) return double (n);
+
+    // Only the first batches*batch values are batched
+    double batch_mean_total = 0, batch_variance = 0;
+    std::vector<double> batch_means (batches);
+    for (std::size_t b = 0; b < batches; ++b) {
+        double sum = 0;
+        for (std::size_t i = b * batch; i < (b+1) * batch; ++i) sum += values[i];
+        batch_means[b] = sum / batch;
+        batch_mean_total += batch_means[b];
+    }
+    const double batch_mean = batch_mean_total / batches;
+    for (double m : batch_means) batch_variance += (m - batch_mean) * (m - batch_mean);
+    batch_variance /= batches - 1;
+    if (!(batch_variance > 0)) return double (n);
+
+    return std::min (double (n), n * variance / (batch * batch_variance));
+}
+
+
+std::string utility::quoted (const std::string& s) {
+    std::string result = "\"";
+    for (char c : s) {
+        if (c == '"' || c == '\\') result += '\\';
+        result += c;
+    }
+    return result + "\"";
+}
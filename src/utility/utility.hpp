@@ -12,13 +12,22 @@
 #include <cstdio>
 #include <utility>
 #include <memory>
+#include <string>
 #include <type_traits>
+#include <vector>
 
 namespace utility {
     
     std::shared_ptr<FILE> open_file (const char* filename, const char* mode);
     
     std::shared_ptr<FILE> open_process (const char* command, const char* mode);
+    
+    /** Effective sample size of a correlated sequence, estimated by batch means with about
+     sqrt(n) batches of about sqrt(n) values each. */
+    double effective_sample_size (const std::vector<double>&);
+
+    /** The string as a JSON string literal, with quotes and backslashes escaped */
+    std::string quoted (const std::string&);
 
     /** Implementation from http://isocpp.org/files/papers/N3656.txt */
     
@@ -2,6 +2,7 @@
 #include <utility>
 #include <cassert>
 #include <random>
+#include <iterator>
 
 #include "utility/bitree.hpp"
 #include "utility/random.hpp"
@@ -150,6 +151,13 @@ bool test_2 (random_source& random) {
         }
     }
     
+    for (size_t i = 0; i <= seq.size(); ++i) {
+        vector<group> sums;
+        seq.accumulate_range (i, seq.size()+1, back_inserter(sums));
+        assert (sums.size() == seq.size()+1-i);
+        for (size_t j = 0; j < sums.size(); ++j) assert (sums[j] == seq.accumulate(i+j));
+    }
+    
     return true;
 }
 
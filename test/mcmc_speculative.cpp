@@ -0,0 +1,68 @@
+#include <iostream>
+#include <cassert>
+#include <memory>
+#include <string>
+#include <tuple>
+
+#include <boost/program_options.hpp>
+
+#include "slam/slam_data.hpp"
+#include "slam/slam_initialiser.hpp"
+#include "slam/mcmc_slam.hpp"
+#include "utility/thread_pool.hpp"
+
+#include "main.hpp"
+#include "dataset.hpp"
+
+using namespace std;
+
+using slam_data_type = slam::slam_data<control_model_type, observation_model_type>;
+using slam_dataset_type = slam::dataset<control_model_type, observation_model_type>;
+using slam_initialiser_type = slam::slam_initialiser<control_model_type, observation_model_type>;
+using mcmc_slam_type = slam::mcmc_slam<control_model_type, observation_model_type>;
+
+const unsigned int seed = 1;
+const size_t num_updates = 4000;
+
+// Chains with the same seed and data, each updated speculatively with a different number of threads
+void check_thread_independence (const string& dataset_dir) {
+    namespace po = boost::program_options;
+    po::options_description options;
+    options.add (control_model_type::builder::program_options());
+    options.add (observation_model_type::builder::program_options());
+    po::variables_map values;
+    po::store (po::command_line_parser (0, (char**)nullptr).options (options).run(), values);
+    po::notify (values);
+
+    shared_ptr<slam_dataset_type> dataset;
+    tie (dataset, ignore) = read_range_only_data (dataset_dir, "Plaza1");
+
+    auto data = make_shared<slam_data_type>();
+    auto init = make_shared<slam_initialiser_type> (seed);
+    data->add_listener (init);
+
+    auto serial = make_shared<mcmc_slam_type> (data, seed);
+    auto parallel = make_shared<mcmc_slam_type> (data, seed);
+    for (auto chain : { serial, parallel }) {
+        chain->set_initialiser (init);
+        data->add_timestep_listener (chain);
+    }
+    data->add_dataset (*dataset, control_model_type::builder (values), observation_model_type::builder (values));
+
+    utility::thread_pool one (1), many (4);
+    const size_t serial_accepted = serial->update_states_speculative (one, num_updates);
+    const size_t parallel_accepted = parallel->update_states_speculative (many, num_updates);
+
+    assert (serial_accepted > 0);
+    assert (serial_accepted == parallel_accepted);
+    assert (serial->get_log_likelihood() == parallel->get_log_likelihood());
+    assert (serial->current_timestep() == parallel->current_timestep());
+    for (slam::timestep_type t (0); t <= serial->current_timestep(); ++t) {
+        assert (serial->get_state (t).to_vector() == parallel->get_state (t).to_vector());
+    }
+}
+
+int main (int argc, char* argv[]) {
+    check_thread_independence (argc > 1 ? argv[1] : "input");
+    cout << "mcmc_speculative tests passed" << endl;
+}
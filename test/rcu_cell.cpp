@@ -0,0 +1,84 @@
+#include <iostream>
+#include <cassert>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <memory>
+
+#include "utility/rcu_cell.hpp"
+
+using namespace std;
+using utility::rcu_cell;
+
+atomic<int> live (0);
+
+struct value {
+    unsigned long n;
+    vector<unsigned long> copies;
+    explicit value (unsigned long n) : n(n), copies (64, n) { ++live; }
+    ~value () { n = 0; copies.assign (copies.size(), 1); --live; }
+};
+
+void check_single_thread () {
+    rcu_cell<value> cell;
+    rcu_cell<value>::reader reader (cell);
+    assert (!reader.read());
+
+    cell.publish (unique_ptr<const value> (new value (1)));
+    {
+        auto guard = reader.read();
+        assert (guard->n == 1);
+        cell.publish (unique_ptr<const value> (new value (2)));
+        cell.publish (unique_ptr<const value> (new value (3)));
+        // Value 1 is still held, so it and everything retired after it are kept
+        assert (guard->n == 1);
+        assert (cell.num_retired() == 2);
+        assert (live == 3);
+    }
+    cell.publish (unique_ptr<const value> (new value (4)));
+    assert (cell.num_retired() == 0);
+    assert (live == 1);
+    assert (reader.read()->n == 4);
+}
+
+void check_concurrent () {
+    const unsigned long num_values = 200000;
+    const unsigned int num_readers = 4;
+
+    rcu_cell<value> cell;
+    atomic<bool> done (false);
+    vector<thread> readers;
+
+    for (unsigned int i = 0; i < num_readers; ++i) {
+        readers.emplace_back ([&]() {
+            rcu_cell<value>::reader reader (cell);
+            unsigned long last = 0;
+            while (!done.load()) {
+                auto guard = reader.read();
+                if (!guard) continue;
+                // Values are published in order, and must not be destroyed while held
+                assert (guard->n >= last);
+                for (auto c : guard->copies) assert (c == guard->n);
+                last = guard->n;
+            }
+        });
+    }
+
+    for (unsigned long n = 1; n <= num_values; ++n) {
+        cell.publish (unique_ptr<const value> (new value (n)));
+    }
+    done = true;
+    for (auto& t : readers) t.join();
+
+    cell.publish (unique_ptr<const value> (new value (num_values+1)));
+    assert (cell.num_retired() == 0);
+    assert (live == 1);
+}
+
+int main () {
+    check_single_thread();
+    assert (live == 0);
+    check_concurrent();
+    assert (live == 0);
+    cout << "rcu_cell tests passed" << endl;
+}